@@ -0,0 +1,18 @@
+#!/bin/sh
+# Benchmark: nanovg's fringe antialiasing against MSAA. Loads the same
+# board, replaying its journals, in each mode and draws all of it FRAMES
+# times, without the layer that usually spares redrawing it.
+#
+#   cmake --build build && bench/antialias.sh build/ward board.ward [frames]
+#
+# WARD_DEPTH_STROKES and the other settings in the environment apply to
+# both runs.
+set -e
+ward=${1:?usage: $0 path/to/ward board.ward [frames]}
+board=${2:?usage: $0 path/to/ward board.ward [frames]}
+frames=${3:-200}
+
+for samples in 0 4 8; do
+    WARD_MSAA=$samples WARD_BENCH_FRAMES=$frames "$ward" "$board" |
+        grep '^bench:'
+done
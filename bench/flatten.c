@@ -0,0 +1,167 @@
+// Microbenchmark: nanovg's cubic flattening, the iterative flattener
+// against the recursive subdivision it replaced. Reports time and points
+// per curve, and how far each polyline strays from the exact curve, for
+// curves of a few pixels to a few thousand.
+//
+//   cmake --build build --target bench-flatten && ./build/bench-flatten
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../nanovg/nanovg.c"
+
+// the recursive flattener nanovg shipped with, kept as the reference.
+static void tesselateBezierRecursive(NVGcontext* ctx,
+									 float x1, float y1, float x2, float y2,
+									 float x3, float y3, float x4, float y4,
+									 int level, int type)
+{
+	float x12,y12,x23,y23,x34,y34,x123,y123,x234,y234,x1234,y1234;
+	float dx,dy,d2,d3;
+
+	if (level > 10) return;
+
+	x12 = (x1+x2)*0.5f;
+	y12 = (y1+y2)*0.5f;
+	x23 = (x2+x3)*0.5f;
+	y23 = (y2+y3)*0.5f;
+	x34 = (x3+x4)*0.5f;
+	y34 = (y3+y4)*0.5f;
+	x123 = (x12+x23)*0.5f;
+	y123 = (y12+y23)*0.5f;
+
+	dx = x4 - x1;
+	dy = y4 - y1;
+	d2 = nvg__absf(((x2 - x4) * dy - (y2 - y4) * dx));
+	d3 = nvg__absf(((x3 - x4) * dy - (y3 - y4) * dx));
+
+	if ((d2 + d3)*(d2 + d3) < ctx->tessTol * (dx*dx + dy*dy)) {
+		nvg__addPoint(ctx, x4, y4, type);
+		return;
+	}
+
+	x234 = (x23+x34)*0.5f;
+	y234 = (y23+y34)*0.5f;
+	x1234 = (x123+x234)*0.5f;
+	y1234 = (y123+y234)*0.5f;
+
+	tesselateBezierRecursive(ctx, x1,y1, x12,y12, x123,y123, x1234,y1234, level+1, 0);
+	tesselateBezierRecursive(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
+}
+
+static int stubCreate(void* uptr) { NVG_NOTUSED(uptr); return 1; }
+static int stubCreateTexture(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data)
+{
+	NVG_NOTUSED(uptr); NVG_NOTUSED(type); NVG_NOTUSED(w); NVG_NOTUSED(h);
+	NVG_NOTUSED(imageFlags); NVG_NOTUSED(data);
+	return 1;
+}
+static int stubDeleteTexture(void* uptr, int image) { NVG_NOTUSED(uptr); NVG_NOTUSED(image); return 1; }
+static void stubDelete(void* uptr) { NVG_NOTUSED(uptr); }
+
+enum { NCURVES = 4096, NREPS = 50 };
+
+typedef struct Curve { float p[8]; } Curve;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float frand(float lo, float hi) { return lo + (hi - lo) * (rand() / (float)RAND_MAX); }
+
+// distance from (x, y) to the polyline of the path cache.
+static float distToPolyline(NVGcontext* ctx, float x, float y)
+{
+	NVGpoint* pts = ctx->cache->points;
+	float best = 1e30f;
+	int i;
+	for (i = 0; i + 1 < ctx->cache->npoints; i++) {
+		best = nvg__minf(best, nvg__distPtSeg(x, y, pts[i].x, pts[i].y, pts[i+1].x, pts[i+1].y));
+	}
+	return sqrtf(best);
+}
+
+static void flatten(NVGcontext* ctx, const Curve* c, int recursive)
+{
+	const float* p = c->p;
+	nvg__clearPathCache(ctx);
+	nvg__addPath(ctx);
+	nvg__addPoint(ctx, p[0], p[1], NVG_PT_CORNER);
+	if (recursive)
+		tesselateBezierRecursive(ctx, p[0],p[1], p[2],p[3], p[4],p[5], p[6],p[7], 0, NVG_PT_CORNER);
+	else
+		nvg__flattenBezier(ctx, p[0],p[1], p[2],p[3], p[4],p[5], p[6],p[7], NVG_PT_CORNER);
+}
+
+static void run(NVGcontext* ctx, const Curve* curves, float scale, int recursive)
+{
+	double t0, t1;
+	long npoints = 0;
+	float err = 0;
+	int i, r, k;
+
+	t0 = now();
+	for (r = 0; r < NREPS; r++) {
+		for (i = 0; i < NCURVES; i++) {
+			flatten(ctx, &curves[i], recursive);
+			npoints += ctx->cache->npoints;
+		}
+	}
+	t1 = now();
+
+	// a sample of the curves, against the exact curve.
+	for (i = 0; i < NCURVES; i += 16) {
+		const float* p = curves[i].p;
+		flatten(ctx, &curves[i], recursive);
+		for (k = 0; k <= 64; k++) {
+			float t = k / 64.0f, s = 1 - t;
+			float x = s*s*s*p[0] + 3*s*s*t*p[2] + 3*s*t*t*p[4] + t*t*t*p[6];
+			float y = s*s*s*p[1] + 3*s*s*t*p[3] + 3*s*t*t*p[5] + t*t*t*p[7];
+			err = nvg__maxf(err, distToPolyline(ctx, x, y));
+		}
+	}
+	printf("  %-9s %6.0f px: %7.1f ns/curve %7.1f points/curve  max error %.3f px\n",
+		   recursive ? "recursive" : "iterative", scale,
+		   (t1 - t0) * 1e9 / (NREPS * NCURVES), npoints / (double)(NREPS * NCURVES), err);
+}
+
+int main()
+{
+	static const float scales[] = { 4, 32, 256, 2048 };
+	NVGparams params;
+	NVGcontext* ctx;
+	Curve* curves = (Curve*)malloc(sizeof(Curve) * NCURVES);
+	int s, i, k;
+
+	memset(&params, 0, sizeof(params));
+	params.renderCreate = stubCreate;
+	params.renderCreateTexture = stubCreateTexture;
+	params.renderDeleteTexture = stubDeleteTexture;
+	params.renderDelete = stubDelete;
+	ctx = nvgCreateInternal(&params);
+	if (ctx == NULL) {
+		fprintf(stderr, "unable to create a nanovg context\n");
+		return 1;
+	}
+	nvg__setDevicePixelRatio(ctx, 1.0f);
+	printf("tessTol %.2f px, %d curves x %d reps\n", ctx->tessTol, NCURVES, NREPS);
+
+	for (s = 0; s < 4; s++) {
+		srand(1);
+		for (i = 0; i < NCURVES; i++) {
+			for (k = 0; k < 8; k++) {
+				curves[i].p[k] = frand(0, scales[s]);
+			}
+		}
+		run(ctx, curves, scales[s], 1);
+		run(ctx, curves, scales[s], 0);
+	}
+
+	nvgDeleteInternal(ctx);
+	free(curves);
+	return 0;
+}
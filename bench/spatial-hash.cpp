@@ -0,0 +1,195 @@
+// Microbenchmark: the eraser's spatial hash against the unordered_map of
+// unordered_sets it replaced. Random walk strokes are inserted, then swept
+// with eraser drags: once only querying, once erasing what is hit.
+//
+//   cmake --build build --target bench-spatial-hash &&
+//   ./build/bench-spatial-hash [npoints]
+//
+// Both structures hold the same line pieces in the same cells of 128, are
+// queried with the same sweeps, and test pieces against the capsules the
+// same way, so only the structure differs. Erasing marks pieces erased and
+// leaves them in the hash, as main.cpp does.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../spatial-hash.h"
+
+using namespace std;
+
+static const int CELL_SZ = 128;  // HASH_CELL_SZ in main.cpp.
+static const int BOARD_W = 40000, BOARD_H = 20000;
+static const int ERASER_RADIUS = 100;  // MAX_ERASER_RADIUS in main.cpp.
+static const int NSWEEPS = 20000;
+static const int CAPSULES_PER_SWEEP = 4;
+
+struct hash_pair_int {
+    size_t operator()(const pair<int, int> &p) const {
+        return hash<int>()(p.first) * 31 + hash<int>()(p.second);
+    }
+};
+struct hash_guid {
+    size_t operator()(const SegPointGuid &v) const {
+        return hash<int>()(v.point_guid) * 31 + hash<int>()(v.seg_guid);
+    }
+};
+typedef unordered_map<pair<int, int>, unordered_set<SegPointGuid, hash_guid>,
+                      hash_pair_int>
+    OldHash;
+
+static vector<vector<V2<int>>> g_strokes;
+
+// call f(guid, from, to) for every piece of the old hash within the sweep.
+template <typename F>
+static void old_query(const OldHash &h, const Sweep &sweep, F f) {
+    static vector<Cell> cells;
+    sweep.cells(CELL_SZ, cells);
+    for (const Cell &c : cells) {
+        auto it = h.find(make_pair(c.cx, c.cy));
+        if (it == h.end()) {
+            continue;
+        }
+        for (const SegPointGuid &v : it->second) {
+            const V2<int> a = g_strokes[v.seg_guid][v.point_guid];
+            const V2<int> b = g_strokes[v.seg_guid][v.point_guid + 1];
+            if (sweep.hits(a, b)) {
+                f(v, a, b);
+            }
+        }
+    }
+}
+
+static double ms_since(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// erase sweeps, as flush_eraser does: skip pieces erased before or already
+// hit through another cell, mark the rest, and sort them for the command.
+struct Eraser {
+    vector<vector<char>> erased;
+    vector<SegPointGuid> hit;
+
+    Eraser() {
+        for (const vector<V2<int>> &s : g_strokes) {
+            erased.push_back(vector<char>(s.size() - 1, 0));
+        }
+    }
+
+    void operator()(SegPointGuid v, V2<int>, V2<int>) {
+        char &e = erased[v.seg_guid][v.point_guid];
+        if (e) {
+            return;
+        }
+        e = 1;
+        hit.push_back(v);
+    }
+
+    void flush() {
+        sort(hit.begin(), hit.end());
+        hit.clear();
+    }
+};
+
+int main(int argc, char **argv) {
+    const int npoints = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int per_stroke = 250;
+    srand(1);
+    for (int n = 0; n < npoints; n += per_stroke) {
+        vector<V2<int>> s;
+        V2<int> p(rand() % BOARD_W, rand() % BOARD_H);
+        for (int i = 0; i < per_stroke; ++i) {
+            s.push_back(p);
+            p = p + V2<int>(rand() % 21 - 10, rand() % 21 - 10);
+        }
+        g_strokes.push_back(s);
+    }
+    // each sweep is a short eraser drag, the motion between two flushes.
+    vector<Sweep> sweeps(NSWEEPS);
+    for (Sweep &sweep : sweeps) {
+        V2<int> p(rand() % BOARD_W, rand() % BOARD_H);
+        for (int i = 0; i < CAPSULES_PER_SWEEP; ++i) {
+            const V2<int> q = p + V2<int>(rand() % 81 - 40, rand() % 81 - 40);
+            sweep.add(p, q, ERASER_RADIUS);
+            p = q;
+        }
+    }
+    printf("%d points in %d strokes, eraser radius %d, %d sweeps of %d\n",
+           npoints, (int)g_strokes.size(), ERASER_RADIUS, NSWEEPS,
+           CAPSULES_PER_SWEEP);
+
+    // insert.
+    auto t0 = chrono::steady_clock::now();
+    OldHash old_hash;
+    for (int s = 0; s < (int)g_strokes.size(); ++s) {
+        for (int i = 0; i + 1 < (int)g_strokes[s].size(); ++i) {
+            for_cells(CELL_SZ, g_strokes[s][i], g_strokes[s][i + 1], 0,
+                      [&](int cx, int cy) {
+                          old_hash[make_pair(cx, cy)].insert(
+                              SegPointGuid(s, i));
+                      });
+        }
+    }
+    const double old_insert = ms_since(t0);
+    t0 = chrono::steady_clock::now();
+    SpatialHash new_hash(CELL_SZ);
+    for (int s = 0; s < (int)g_strokes.size(); ++s) {
+        for (int i = 0; i + 1 < (int)g_strokes[s].size(); ++i) {
+            new_hash.insert(g_strokes[s][i], g_strokes[s][i + 1],
+                            SegPointGuid(s, i));
+        }
+    }
+    const double new_insert = ms_since(t0);
+
+    // query only.
+    long old_hits = 0, new_hits = 0;
+    t0 = chrono::steady_clock::now();
+    for (const Sweep &sweep : sweeps) {
+        old_query(old_hash, sweep,
+                  [&](SegPointGuid, V2<int>, V2<int>) { old_hits++; });
+    }
+    const double old_q = ms_since(t0);
+    t0 = chrono::steady_clock::now();
+    for (const Sweep &sweep : sweeps) {
+        new_hash.query_swept(
+            sweep, [&](SegPointGuid, V2<int>, V2<int>) { new_hits++; });
+    }
+    const double new_q = ms_since(t0);
+
+    // erase what every sweep hits.
+    Eraser old_eraser;
+    t0 = chrono::steady_clock::now();
+    for (const Sweep &sweep : sweeps) {
+        old_query(old_hash, sweep, [&](SegPointGuid v, V2<int> a, V2<int> b) {
+            old_eraser(v, a, b);
+        });
+        old_eraser.flush();
+    }
+    const double old_e = ms_since(t0);
+    Eraser new_eraser;
+    t0 = chrono::steady_clock::now();
+    for (const Sweep &sweep : sweeps) {
+        new_hash.query_swept(sweep, [&](SegPointGuid v, V2<int> a, V2<int> b) {
+            new_eraser(v, a, b);
+        });
+        new_eraser.flush();
+    }
+    const double new_e = ms_since(t0);
+    if (old_eraser.erased != new_eraser.erased) {
+        printf("the two hashes erased different pieces\n");
+        return 1;
+    }
+
+    printf("%-22s %10s %10s\n", "", "old", "new");
+    printf("%-22s %8.1fms %8.1fms\n", "insert", old_insert, new_insert);
+    printf("%-22s %8.1fms %8.1fms  (%ld, %ld hits)\n", "query sweeps", old_q,
+           new_q, old_hits, new_hits);
+    printf("%-22s %8.1fms %8.1fms\n", "erase sweeps", old_e, new_e);
+    return 0;
+}
@@ -0,0 +1,468 @@
+#include "board.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+static uint64_t align_up(uint64_t n) {
+    return (n + BOARD_ALIGN - 1) / BOARD_ALIGN * BOARD_ALIGN;
+}
+
+MappedBoard::~MappedBoard() { close(); }
+
+void MappedBoard::close() {
+    if (base) {
+        munmap(base, size);
+    }
+    base = nullptr;
+    size = 0;
+    header = nullptr;
+    segments = nullptr;
+    regions = nullptr;
+    points = nullptr;
+    created = erased = nullptr;
+    handles = nullptr;
+    chunks = nullptr;
+    index = MappedSpatialHash();
+}
+
+bool MappedBoard::open(const char *path) {
+    assert(!base && "board already open");
+    const int fd = ::open(path, O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "board: unable to open " << path << ": "
+                  << strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BoardHeader)) {
+        std::cerr << "board: " << path << " is too small to be a board\n";
+        ::close(fd);
+        return false;
+    }
+    size = st.st_size;
+    // private: erasing a loaded piece writes its epoch, and those writes
+    // must never reach the file.
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "board: unable to map " << path << ": "
+                  << strerror(errno) << "\n";
+        base = nullptr;
+        size = 0;
+        return false;
+    }
+
+    const BoardHeader *h = (const BoardHeader *)base;
+    if (memcmp(h->magic, BOARD_MAGIC, sizeof(BOARD_MAGIC)) != 0 ||
+        h->version != BOARD_VERSION || h->file_size != size) {
+        std::cerr << "board: " << path << " is not a version "
+                  << BOARD_VERSION << " board\n";
+        close();
+        return false;
+    }
+    if (!valid()) {
+        std::cerr << "board: " << path << " is corrupt\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedBoard::valid() {
+    char *p = (char *)base;
+    const BoardHeader *h = (const BoardHeader *)p;
+    // every block must lie inside the file.
+    auto fits = [&](uint64_t offset, uint64_t n, uint64_t elem) {
+        return offset % BOARD_ALIGN == 0 && offset <= size &&
+               n <= (size - offset) / elem;
+    };
+    // counts are used as ints.
+    if (h->nsegments > INT_MAX || h->nregions > INT_MAX ||
+        h->npoints > INT_MAX / 2 || h->nchunks > INT_MAX ||
+        h->nentries > INT_MAX || h->nslots > ((uint64_t)1 << 31) ||
+        h->cell_sz == 0 || h->cell_sz > INT_MAX || h->chunk_pieces == 0 ||
+        h->chunk_pieces > INT_MAX) {
+        return false;
+    }
+    if (!fits(h->segments_offset, h->nsegments, sizeof(BoardSegment)) ||
+        !fits(h->regions_offset, h->nregions, sizeof(BoardRegion)) ||
+        !fits(h->points_offset, h->npoints, sizeof(V2<int>)) ||
+        !fits(h->created_offset, h->npoints, sizeof(int)) ||
+        !fits(h->erased_offset, h->npoints, sizeof(int)) ||
+        !fits(h->handles_offset, 2 * h->npoints, sizeof(V2<int>)) ||
+        !fits(h->chunks_offset, h->nchunks, sizeof(BoardChunk)) ||
+        !fits(h->slots_offset, h->nslots, sizeof(MappedSpatialHash::Slot)) ||
+        !fits(h->entries_offset, h->nentries, sizeof(SegPointGuid)) ||
+        (h->nslots & (h->nslots - 1)) != 0) {
+        return false;
+    }
+    header = h;
+    segments = (const BoardSegment *)(p + h->segments_offset);
+    regions = (const BoardRegion *)(p + h->regions_offset);
+    points = (V2<int> *)(p + h->points_offset);
+    created = (int *)(p + h->created_offset);
+    erased = (int *)(p + h->erased_offset);
+    handles = (const V2<int> *)(p + h->handles_offset);
+    chunks = (const BoardChunk *)(p + h->chunks_offset);
+    index.cell_sz = h->cell_sz;
+    index.slots = (const MappedSpatialHash::Slot *)(p + h->slots_offset);
+    index.nslots = h->nslots;
+    index.entries = (const SegPointGuid *)(p + h->entries_offset);
+
+    for (uint64_t i = 0; i < h->nregions; ++i) {
+        const BoardRegion &r = regions[i];
+        if (r.first_point > r.end_point || r.end_point > h->npoints) {
+            return false;
+        }
+    }
+    // a segment's points lie in its region.
+    for (uint64_t i = 0; i < h->nsegments; ++i) {
+        const BoardSegment &s = segments[i];
+        if (s.region >= h->nregions) {
+            return false;
+        }
+        const BoardRegion &r = regions[s.region];
+        if (s.first_point < r.first_point || s.first_point > r.end_point ||
+            s.npoints > r.end_point - s.first_point) {
+            return false;
+        }
+    }
+    // the chunks of a segment are consecutive, in order, and each starts
+    // at a piece of it: a segment of fewer than two points has none.
+    std::vector<int64_t> first_chunk(h->nsegments, -1);
+    for (uint64_t i = 0; i < h->nchunks; ++i) {
+        const BoardChunk &c = chunks[i];
+        if (c.seg_guid < 0 || (uint64_t)c.seg_guid >= h->nsegments ||
+            c.begin < 0 || c.begin % h->chunk_pieces != 0) {
+            return false;
+        }
+        const BoardSegment &s = segments[c.seg_guid];
+        if ((uint64_t)c.begin + 1 >= s.npoints) {
+            return false;
+        }
+        if (c.begin == 0) {
+            first_chunk[c.seg_guid] = i;
+        }
+        if (first_chunk[c.seg_guid] == -1 ||
+            first_chunk[c.seg_guid] + c.begin / h->chunk_pieces !=
+                (int64_t)i) {
+            return false;
+        }
+    }
+    // the index: every cell's entries are in the entry block, there is an
+    // empty slot to end every probe, and every entry is a piece.
+    uint64_t nempty = 0;
+    for (uint64_t i = 0; i < h->nslots; ++i) {
+        const MappedSpatialHash::Slot &s = index.slots[i];
+        if (s.count == 0) {
+            nempty++;
+        } else if (s.count < 0 || (uint64_t)s.count > h->nentries ||
+                   s.begin < 0 ||
+                   (uint64_t)s.begin > h->nentries - s.count) {
+            return false;
+        }
+    }
+    if (h->nslots > 0 && nempty == 0) {
+        return false;
+    }
+    for (uint64_t i = 0; i < h->nentries; ++i) {
+        const SegPointGuid &v = index.entries[i];
+        if (v.seg_guid < 0 || (uint64_t)v.seg_guid >= h->nsegments ||
+            v.point_guid < 0 ||
+            (uint64_t)v.point_guid + 1 >= segments[v.seg_guid].npoints) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BoardWriter::~BoardWriter() {
+    if (fd != -1) {
+        close(fd);
+        unlink(tmp_path);
+    }
+}
+
+void BoardWriter::reserve(uint64_t nindex) {
+    cell_entries.reserve(nindex);
+    entries.reserve(nindex);
+    cells.reserve(nindex);
+    uint64_t nslots = 64;
+    while (nslots < 2 * nindex) {
+        nslots *= 2;
+    }
+    slots.reserve(nslots);
+}
+
+// append the string `s` to buf[0, n) at `at`, truncating.
+static size_t append_str(char *buf, size_t n, size_t at, const char *s) {
+    while (*s && at + 1 < n) {
+        buf[at++] = *s++;
+    }
+    buf[at] = '\0';
+    return at;
+}
+
+void BoardWriter::fail(const char *what, int error) {
+    // no stdio: this may run in a forked child.
+    char msg[PATH_MAX + 128];
+    size_t n = append_str(msg, sizeof(msg), 0, "board: ");
+    n = append_str(msg, sizeof(msg), n, what);
+    n = append_str(msg, sizeof(msg), n, " ");
+    n = append_str(msg, sizeof(msg), n, tmp_path);
+    if (error) {
+        // strerror may allocate, or take a lock.
+        char num[16];
+        int i = sizeof(num) - 1;
+        num[i] = '\0';
+        do {
+            num[--i] = '0' + error % 10;
+            error /= 10;
+        } while (error > 0 && i > 0);
+        n = append_str(msg, sizeof(msg), n, ": errno ");
+        n = append_str(msg, sizeof(msg), n, num + i);
+    }
+    n = append_str(msg, sizeof(msg), n, "\n");
+    if (write(2, msg, n) < 0) {
+        // nowhere left to report it.
+    }
+    ok = false;
+}
+
+bool BoardWriter::write_at(uint64_t offset, const void *p, size_t n) {
+    const char *c = (const char *)p;
+    while (ok && n > 0) {
+        const ssize_t w = pwrite(fd, c, n, offset);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            fail("write to", errno);
+            break;
+        }
+        c += w;
+        n -= w;
+        offset += w;
+    }
+    return ok;
+}
+
+bool BoardWriter::begin(const char *path, uint64_t nsegments,
+                        uint64_t nregions, uint64_t npoints, uint64_t nchunks,
+                        int chunk_pieces,
+                        int cell_sz, uint32_t journal_generation) {
+    assert(fd == -1 && "board writer already in use");
+    if (strlen(path) + sizeof(".tmp") > sizeof(tmp_path)) {
+        return false;
+    }
+    append_str(this->path, sizeof(this->path), 0, path);
+    append_str(tmp_path, sizeof(tmp_path),
+               append_str(tmp_path, sizeof(tmp_path), 0, path), ".tmp");
+    fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fail("unable to create", errno);
+        return false;
+    }
+    ok = true;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BOARD_MAGIC, sizeof(BOARD_MAGIC));
+    h.version = BOARD_VERSION;
+    h.chunk_pieces = chunk_pieces;
+    h.cell_sz = cell_sz;
+    h.journal_generation = journal_generation;
+    h.nsegments = nsegments;
+    h.nregions = nregions;
+    h.npoints = npoints;
+    h.nchunks = nchunks;
+    h.segments_offset = align_up(sizeof(BoardHeader));
+    h.regions_offset =
+        align_up(h.segments_offset + nsegments * sizeof(BoardSegment));
+    h.points_offset =
+        align_up(h.regions_offset + nregions * sizeof(BoardRegion));
+    h.created_offset = align_up(h.points_offset + npoints * sizeof(V2<int>));
+    h.erased_offset = align_up(h.created_offset + npoints * sizeof(int));
+    h.handles_offset = align_up(h.erased_offset + npoints * sizeof(int));
+    h.chunks_offset =
+        align_up(h.handles_offset + 2 * npoints * sizeof(V2<int>));
+    // the index goes last: its size is only known at the end.
+    h.slots_offset = align_up(h.chunks_offset + nchunks * sizeof(BoardChunk));
+    return true;
+}
+
+void BoardWriter::add_segment(int seg_guid, Color color,
+                              const V2<int> *points, const int *created,
+                              const int *erased, const V2<int> *handles,
+                              int npoints) {
+    assert(segs_done < h.nsegments && 0 <= seg_guid &&
+           (uint64_t)seg_guid < h.nsegments);
+    assert(regions_done < h.nregions);
+    assert(points_done + npoints <= h.npoints);
+    BoardSegment s;
+    memset(&s, 0, sizeof(s));
+    s.first_point = points_done;
+    s.npoints = npoints;
+    s.region = regions_done;
+    s.r = color.r, s.g = color.g, s.b = color.b;
+    write_at(h.segments_offset + seg_guid * sizeof(s), &s, sizeof(s));
+    for (int i = 0; i < npoints; ++i) {
+        region_bounds.add(points[i]);
+    }
+    for (int i = 0; i < 2 * (npoints - 1); ++i) {
+        region_bounds.add(handles[i]);
+    }
+    write_at(h.points_offset + points_done * sizeof(V2<int>), points,
+             npoints * sizeof(V2<int>));
+    if (npoints > 1) {
+        write_at(h.created_offset + points_done * sizeof(int), created,
+                 (npoints - 1) * sizeof(int));
+        write_at(h.erased_offset + points_done * sizeof(int), erased,
+                 (npoints - 1) * sizeof(int));
+        write_at(h.handles_offset + 2 * points_done * sizeof(V2<int>),
+                 handles, 2 * (npoints - 1) * sizeof(V2<int>));
+    }
+    segs_done++;
+    points_done += npoints;
+}
+
+void BoardWriter::end_region() {
+    assert(regions_done < h.nregions);
+    BoardRegion r;
+    r.first_point = region_first_point;
+    r.end_point = points_done;
+    box_to_board(region_bounds, r.bounds);
+    write_at(h.regions_offset + regions_done * sizeof(r), &r, sizeof(r));
+    regions_done++;
+    region_first_point = points_done;
+    region_bounds = Box();
+}
+
+void BoardWriter::add_chunk(int seg_guid, int begin, const Box &bounds,
+                            const Box &ink) {
+    assert(chunks_done < h.nchunks);
+    BoardChunk c;
+    c.seg_guid = seg_guid;
+    c.begin = begin;
+    box_to_board(bounds, c.bounds);
+    box_to_board(ink, c.ink);
+    write_at(h.chunks_offset + chunks_done * sizeof(c), &c, sizeof(c));
+    chunks_done++;
+}
+
+void BoardWriter::index_piece(SegPointGuid v, V2<int> a, V2<int> b) {
+    for_cells(h.cell_sz, a, b, 0, [&](int cx, int cy) {
+        if (cell_entries.size() == cell_entries.capacity()) {
+            // growing would allocate.
+            if (ok) {
+                fail("index outgrew its reserve in", 0);
+            }
+            return;
+        }
+        Cell c;
+        c.cx = cx;
+        c.cy = cy;
+        cell_entries.push_back(std::make_pair(c, v));
+    });
+}
+
+bool BoardWriter::finish() {
+    assert(segs_done == h.nsegments && regions_done == h.nregions &&
+           points_done == h.npoints && chunks_done == h.nchunks);
+
+    // group entries by cell, then lay the cells out in a table at most
+    // half full, the same way SpatialHash probes.
+    std::sort(cell_entries.begin(), cell_entries.end(),
+              [](const std::pair<Cell, SegPointGuid> &a,
+                 const std::pair<Cell, SegPointGuid> &b) {
+                  return a.first < b.first;
+              });
+    entries.resize(cell_entries.size());
+    cells.clear();
+    for (size_t i = 0; i < cell_entries.size(); ++i) {
+        entries[i] = cell_entries[i].second;
+        if (i == 0 || !(cell_entries[i].first == cell_entries[i - 1].first)) {
+            MappedSpatialHash::Slot s;
+            s.cx = cell_entries[i].first.cx;
+            s.cy = cell_entries[i].first.cy;
+            s.begin = i;
+            s.count = 0;
+            cells.push_back(s);
+        }
+        cells.back().count++;
+    }
+    cell_entries.clear();
+
+    uint64_t nslots = 0;
+    if (!cells.empty()) {
+        nslots = 64;
+        while (nslots < 2 * cells.size()) {
+            nslots *= 2;
+        }
+    }
+    MappedSpatialHash::Slot empty;
+    empty.cx = empty.cy = empty.begin = empty.count = 0;
+    assert(nslots <= slots.capacity());
+    slots.assign(nslots, empty);
+    for (const MappedSpatialHash::Slot &c : cells) {
+        const unsigned mask = nslots - 1;
+        unsigned i = hash_cell(c.cx, c.cy) & mask;
+        while (slots[i].count != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = c;
+    }
+
+    h.nslots = nslots;
+    h.nentries = entries.size();
+    h.entries_offset = align_up(
+        h.slots_offset + nslots * sizeof(MappedSpatialHash::Slot));
+    h.file_size = h.entries_offset + entries.size() * sizeof(SegPointGuid);
+    write_at(h.slots_offset, slots.data(),
+             nslots * sizeof(MappedSpatialHash::Slot));
+    write_at(h.entries_offset, entries.data(),
+             entries.size() * sizeof(SegPointGuid));
+    // the header goes last, so a torn write never looks like a board.
+    write_at(0, &h, sizeof(h));
+    if (ok && ftruncate(fd, h.file_size) != 0) {
+        ok = false;
+    }
+    if (ok && fsync(fd) != 0) {
+        fail("unable to sync", errno);
+    }
+    close(fd);
+    fd = -1;
+    // a board that is mapped right now keeps its old pages: rename only
+    // swaps the name.
+    if (ok && rename(tmp_path, path) != 0) {
+        fail("unable to rename", errno);
+    }
+    if (!ok) {
+        unlink(tmp_path);
+        return false;
+    }
+    // the rename is only durable once the directory is.
+    char dir[PATH_MAX];
+    append_str(dir, sizeof(dir), 0, path);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        slash[slash == dir ? 1 : 0] = '\0';
+    } else {
+        append_str(dir, sizeof(dir), 0, ".");
+    }
+    const int dfd = ::open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd == -1 || fsync(dfd) != 0) {
+        fail("unable to sync the directory of", errno);
+    }
+    if (dfd != -1) {
+        close(dfd);
+    }
+    return ok;
+}
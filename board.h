@@ -0,0 +1,164 @@
+#pragma once
+#include <limits.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "assert.h"
+#include "quadtree.h"
+#include "spatial-hash.h"
+#include "vector-graphics.h"
+
+// Board files.
+// A board is saved as one binary file that is loaded with mmap: the
+// segment table, points, epochs and the eraser's spatial index are used
+// in place, so opening a board costs O(segments + chunks) no matter how
+// many points it holds. Points are only paged in when drawn or erased.
+// The index is read once when the board opens, to check that every entry
+// names a piece of the board.
+//
+// layout, every block aligned to BOARD_ALIGN, all integers native endian:
+//   BoardHeader
+//   BoardSegment[nsegments]
+//   BoardRegion[nregions]
+//   V2<int> points[npoints]          the points of all segments, region by
+//                                    region.
+//   int created[npoints]             piece epochs, indexed like points. the
+//   int erased[npoints]              last entry of each segment is unused.
+//   V2<int> handles[2 * npoints]     the two handles of every piece, indexed
+//                                    like epochs.
+//   BoardChunk[nchunks]              chunk boxes, in paint order.
+//   MappedSpatialHash::Slot[nslots]
+//   SegPointGuid entries[nentries]
+//
+// History is not saved. Epochs are baked: a visible piece has created =
+// -1 and erased = EPOCH_NEVER, so it shows from the first command on. A
+// hidden piece has created = erased = -1: the journal may show it again.
+// A piece that can never come back has created = EPOCH_NEVER.
+//
+// Segment guids are kept, so that the journal following the board can
+// refer to them. A segment with no piece left is stored without points.
+//
+// Segments are grouped into square regions of BOARD_REGION_SZ by the
+// middle of their bounds, and the points, epochs and handles of a region
+// are contiguous, so that a region can be paged in and out on its own.
+
+static const char BOARD_MAGIC[8] = {'W', 'A', 'R', 'D', 'B', 'R', 'D', '\0'};
+static const uint32_t BOARD_VERSION = 4;
+static const uint64_t BOARD_ALIGN = 64;
+static const int BOARD_REGION_SZ = 4096;
+
+struct BoardHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_pieces;  // CHUNK_PIECES the chunks were cut with.
+    uint32_t cell_sz;       // cell size of the spatial index.
+    uint32_t journal_generation;  // first journal to replay on top.
+    uint64_t nsegments, nregions, npoints, nchunks, nslots, nentries;
+    uint64_t segments_offset, regions_offset, points_offset, created_offset, erased_offset,
+        handles_offset, chunks_offset, slots_offset, entries_offset;
+    uint64_t file_size;
+};
+
+struct BoardSegment {
+    uint64_t first_point;  // index into the point and epoch blocks.
+    uint32_t npoints;
+    uint32_t region;
+    uint8_t r, g, b, pad;
+};
+
+struct BoardRegion {
+    uint64_t first_point;  // points [first_point, end_point) of the blocks.
+    uint64_t end_point;
+    int32_t bounds[4];  // every point and handle of the region's segments.
+};
+
+struct BoardChunk {
+    int32_t seg_guid;
+    int32_t begin;
+    int32_t bounds[4];  // lo.x, lo.y, hi.x, hi.y
+    int32_t ink[4];
+};
+
+inline void box_to_board(const Box &b, int32_t out[4]) {
+    out[0] = b.lo.x, out[1] = b.lo.y, out[2] = b.hi.x, out[3] = b.hi.y;
+}
+
+inline Box box_from_board(const int32_t in[4]) {
+    return Box(V2<int>(in[0], in[1]), V2<int>(in[2], in[3]));
+}
+
+// a board file, mapped privately.
+struct MappedBoard {
+    ~MappedBoard();
+    // false if the file cannot be mapped or is not a valid board. Every
+    // offset, count and index in the file is checked here, so a board that
+    // opens can be used without further checks.
+    bool open(const char *path);
+    // unmap the board, if one is open.
+    void close();
+
+    const BoardHeader *header = nullptr;
+    const BoardSegment *segments = nullptr;
+    const BoardRegion *regions = nullptr;
+    V2<int> *points = nullptr;
+    int *created = nullptr;
+    int *erased = nullptr;
+    const V2<int> *handles = nullptr;
+    const BoardChunk *chunks = nullptr;
+    MappedSpatialHash index;
+
+   private:
+    // point the members into the mapping, and check the blocks against the
+    // header and each other.
+    bool valid();
+
+    void *base = nullptr;
+    size_t size = 0;
+};
+
+// writes a board file. Counts are given up front, so that every block is
+// written straight to its final place. Segments are added region by region
+// in any guid order, each region closed by `end_region`. The file appears
+// at `path` only once `finish` succeeds, and its directory is synced.
+// Once `reserve` has been called, the writer neither allocates nor uses
+// stdio, so a forked child of a threaded process can use it.
+struct BoardWriter {
+    ~BoardWriter();
+    // room for `nindex` (cell, piece) pairs of the index. `index_piece`
+    // fails the board past that.
+    void reserve(uint64_t nindex);
+    bool begin(const char *path, uint64_t nsegments, uint64_t nregions,
+               uint64_t npoints, uint64_t nchunks, int chunk_pieces, int cell_sz,
+               uint32_t journal_generation);
+    // `created` and `erased` hold npoints - 1 baked epochs, `handles`
+    // 2 * (npoints - 1) handles.
+    void add_segment(int seg_guid, Color color, const V2<int> *points,
+                     const int *created, const int *erased,
+                     const V2<int> *handles, int npoints);
+    void end_region();
+    void add_chunk(int seg_guid, int begin, const Box &bounds,
+                   const Box &ink);
+    // index the piece `v` of an added segment.
+    void index_piece(SegPointGuid v, V2<int> a, V2<int> b);
+    bool finish();
+
+   private:
+    bool write_at(uint64_t offset, const void *p, size_t n);
+    // write "board: <what> <tmp_path>: <error>" to stderr and fail.
+    void fail(const char *what, int error);
+
+    int fd = -1;
+    bool ok = false;
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    BoardHeader h;
+    uint64_t segs_done = 0, regions_done = 0, points_done = 0,
+             chunks_done = 0;
+    uint64_t region_first_point = 0;
+    Box region_bounds;
+    // (cell, piece) for every cell a piece overlaps.
+    std::vector<std::pair<Cell, SegPointGuid>> cell_entries;
+    // the index, as `finish` lays it out.
+    std::vector<SegPointGuid> entries;
+    std::vector<MappedSpatialHash::Slot> cells, slots;
+};
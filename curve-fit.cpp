@@ -0,0 +1,171 @@
+#include "curve-fit.h"
+
+#include <math.h>
+
+#include "assert.h"
+#include "spatial-hash.h"
+
+typedef V2<double> P;
+
+static double dot(P a, P b) { return a.x * b.x + a.y * b.y; }
+
+static P normalized(P a) {
+    const double len = sqrt(a.lensq());
+    return len == 0 ? a : P(a.x / len, a.y / len);
+}
+
+static P at(const V2<int> *ps, int i) { return ps[i].cast<double>(); }
+
+static V2<int> rounded(P p) { return V2<int>(lround(p.x), lround(p.y)); }
+
+// point of the cubic c at t.
+static P bezier(const P c[4], double t) {
+    const double s = 1 - t;
+    const double b0 = s * s * s, b1 = 3 * s * s * t, b2 = 3 * s * t * t,
+                 b3 = t * t * t;
+    return P(b0 * c[0].x + b1 * c[1].x + b2 * c[2].x + b3 * c[3].x,
+             b0 * c[0].y + b1 * c[1].y + b2 * c[2].y + b3 * c[3].y);
+}
+
+// the handles that fit ps[first, last] best in the least squares sense,
+// keeping the end tangents t1 and t2 and the parameters u.
+static void least_squares(const V2<int> *ps, int first, int last,
+                          const std::vector<double> &u, P t1, P t2, P c[4]) {
+    const P p0 = at(ps, first), p3 = at(ps, last);
+    double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+    for (int i = first; i <= last; ++i) {
+        const double t = u[i - first], s = 1 - t;
+        const double b0 = s * s * s, b1 = 3 * s * s * t, b2 = 3 * s * t * t,
+                     b3 = t * t * t;
+        const P a1(t1.x * b1, t1.y * b1), a2(t2.x * b2, t2.y * b2);
+        c00 += dot(a1, a1);
+        c01 += dot(a1, a2);
+        c11 += dot(a2, a2);
+        const P rest(at(ps, i).x - (b0 + b1) * p0.x - (b2 + b3) * p3.x,
+                     at(ps, i).y - (b0 + b1) * p0.y - (b2 + b3) * p3.y);
+        x0 += dot(a1, rest);
+        x1 += dot(a2, rest);
+    }
+    const double det = c00 * c11 - c01 * c01;
+    double l = det == 0 ? 0 : (x0 * c11 - x1 * c01) / det;
+    double r = det == 0 ? 0 : (c00 * x1 - c01 * x0) / det;
+    // degenerate or flipped handles: fall back to a third of the chord.
+    const double chord = sqrt((p3 - p0).lensq());
+    if (l < 1e-6 * chord || r < 1e-6 * chord) {
+        l = r = chord / 3;
+    }
+    c[0] = p0;
+    c[1] = P(p0.x + t1.x * l, p0.y + t1.y * l);
+    c[2] = P(p3.x + t2.x * r, p3.y + t2.y * r);
+    c[3] = p3;
+}
+
+// one Newton step towards the parameter of the point of c closest to p.
+static double newton_step(const P c[4], P p, double t) {
+    P d1[3], d2[2];
+    for (int i = 0; i < 3; ++i) {
+        d1[i] = P(3 * (c[i + 1].x - c[i].x), 3 * (c[i + 1].y - c[i].y));
+    }
+    for (int i = 0; i < 2; ++i) {
+        d2[i] = P(2 * (d1[i + 1].x - d1[i].x), 2 * (d1[i + 1].y - d1[i].y));
+    }
+    const double s = 1 - t;
+    const P q = bezier(c, t);
+    const P q1(s * s * d1[0].x + 2 * s * t * d1[1].x + t * t * d1[2].x,
+               s * s * d1[0].y + 2 * s * t * d1[1].y + t * t * d1[2].y);
+    const P q2(s * d2[0].x + t * d2[1].x, s * d2[0].y + t * d2[1].y);
+    const P diff = q - p;
+    const double den = dot(q1, q1) + dot(diff, q2);
+    return den == 0 ? t : t - dot(diff, q1) / den;
+}
+
+// squared distance of the farthest point of ps(first, last) from c, and
+// where it is.
+static double max_error(const V2<int> *ps, int first, int last,
+                        const std::vector<double> &u, const P c[4],
+                        int &worst) {
+    double err = 0;
+    worst = (first + last) / 2;
+    for (int i = first + 1; i < last; ++i) {
+        const double d = (bezier(c, u[i - first]) - at(ps, i)).lensq();
+        if (d > err) {
+            err = d;
+            worst = i;
+        }
+    }
+    return err;
+}
+
+static void fit_span(const V2<int> *ps, int first, int last, P t1, P t2,
+                     std::vector<int> &knots, std::vector<V2<int>> &handles) {
+    assert(first < last);
+    const V2<int> a = ps[first], b = ps[last];
+    // two points: a straight piece, with its handles on its knots.
+    if (last - first == 1) {
+        knots.push_back(last);
+        handles.push_back(a);
+        handles.push_back(b);
+        return;
+    }
+
+    // chord length parameters.
+    std::vector<double> u(last - first + 1);
+    u[0] = 0;
+    for (int i = first + 1; i <= last; ++i) {
+        u[i - first] =
+            u[i - first - 1] + sqrt((at(ps, i) - at(ps, i - 1)).lensq());
+    }
+    for (double &t : u) {
+        t = u.back() == 0 ? 0 : t / u.back();
+    }
+
+    const double tol_sq = (double)FIT_TOL * FIT_TOL;
+    const double chord_tol_sq = (double)FIT_CHORD_TOL * FIT_CHORD_TOL;
+    P c[4];
+    int worst = (first + last) / 2;
+    for (int iter = 0; iter < 4; ++iter) {
+        least_squares(ps, first, last, u, t1, t2, c);
+        // the curve is stored with integer handles: judge that one.
+        const V2<int> h1 = rounded(c[1]), h2 = rounded(c[2]);
+        c[1] = h1.cast<double>();
+        c[2] = h2.cast<double>();
+        const double err = max_error(ps, first, last, u, c, worst);
+        const bool bent = dist_sq_point_piece(h1, a, b) > chord_tol_sq ||
+                          dist_sq_point_piece(h2, a, b) > chord_tol_sq;
+        if (err <= tol_sq && !bent) {
+            knots.push_back(last);
+            handles.push_back(h1);
+            handles.push_back(h2);
+            return;
+        }
+        // a good fit that bends too far is halved, which quarters how far
+        // its halves bend.
+        if (err <= tol_sq) {
+            worst = (first + last) / 2;
+            break;
+        }
+        // far off: reparametrizing will not save it.
+        if (err > 4 * tol_sq) {
+            break;
+        }
+        for (int i = first + 1; i < last; ++i) {
+            const double t = newton_step(c, at(ps, i), u[i - first]);
+            u[i - first] = t < 0 ? 0 : t > 1 ? 1 : t;
+        }
+    }
+
+    // split at the worst point, with a tangent shared by both halves.
+    const P mid = normalized(at(ps, worst - 1) - at(ps, worst + 1));
+    fit_span(ps, first, worst, t1, mid, knots, handles);
+    fit_span(ps, worst, last, -mid, t2, knots, handles);
+}
+
+void fit_cubics(const V2<int> *ps, int n, std::vector<int> &knots,
+                std::vector<V2<int>> &handles) {
+    if (n < 2) {
+        return;
+    }
+    const P t1 = normalized(at(ps, 1) - at(ps, 0));
+    const P t2 = normalized(at(ps, n - 2) - at(ps, n - 1));
+    fit_span(ps, 0, n - 1, t1, t2, knots, handles);
+}
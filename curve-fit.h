@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+
+#include "vector-graphics.h"
+
+// Fits a polyline with a piecewise cubic Bézier curve (Schneider's
+// algorithm, from Graphics Gems). Each span runs between two points of the
+// polyline, so the knots are exact samples and only the handles are new.
+// A span is split at its worst point until
+// - no point of the polyline is farther than FIT_TOL from it, and
+// - both of its handles are within FIT_CHORD_TOL of its chord. A span
+//   lies within the hull of its handles, so it then never strays farther
+//   than that from the straight piece between its knots, which is what the
+//   spatial hash and the eraser test against.
+static const float FIT_TOL = 1.0;
+static const float FIT_CHORD_TOL = 2.0;
+
+// fit ps[0, n). appends the index in `ps` of every knot but the first to
+// `knots`, and the two handles of every span to `handles`.
+void fit_cubics(const V2<int> *ps, int n, std::vector<int> &knots,
+                std::vector<V2<int>> &handles);
@@ -0,0 +1,116 @@
+#include "history.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "assert.h"
+
+void compact_command(Command &c) {
+    std::sort(c.begin(), c.end());
+    int out = 0;
+    for (int i = 0; i < (int)c.size(); ++i) {
+        if (out > 0 && c[out - 1].seg_guid == c[i].seg_guid &&
+            c[out - 1].end == c[i].begin) {
+            c[out - 1].end = c[i].end;
+            continue;
+        }
+        c[out++] = c[i];
+    }
+    c.erase(c.begin() + out, c.end());
+    c.shrink_to_fit();
+}
+
+HistorySpill::~HistorySpill() {
+    if (f) {
+        fclose(f);
+    }
+}
+
+int HistorySpill::spill(int first, const std::deque<Command> &cmds,
+                        int max_count) {
+    assert(max_count > 0 && max_count <= (int)cmds.size());
+    // commands paged in earlier are still on disk, unchanged: cutting
+    // history drops the blocks it touches. A block bigger than `max_count`
+    // is split where its first `max_count` commands end.
+    for (int k = 0; k < (int)blocks.size(); ++k) {
+        Block &b = blocks[k];
+        if (b.first != first) {
+            continue;
+        }
+        if (b.count <= max_count) {
+            return b.count;
+        }
+        Block rest;
+        rest.first = b.first + max_count;
+        rest.count = b.count - max_count;
+        rest.offset = b.offset;
+        for (int i = 0; i < max_count; ++i) {
+            rest.offset += sizeof(int) + cmds[i].size() * sizeof(PieceRange);
+        }
+        b.count = max_count;
+        blocks.insert(blocks.begin() + k + 1, rest);
+        return max_count;
+    }
+    assert(blocks.empty() ||
+           blocks.back().first + blocks.back().count == first);
+
+    if (!f) {
+        f = tmpfile();
+        if (!f) {
+            std::cerr << "history: unable to create spill file, keeping "
+                         "history in memory\n";
+            return 0;
+        }
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0) {
+        return 0;
+    }
+    const int count = max_count;
+    Block b;
+    b.first = first;
+    b.count = count;
+    b.offset = ftell(f);
+    for (int i = 0; i < count; ++i) {
+        const Command &c = cmds[i];
+        const int n = c.size();
+        if (fwrite(&n, sizeof(n), 1, f) != 1 ||
+            (n > 0 && fwrite(c.data(), sizeof(PieceRange), n, f) != (size_t)n)) {
+            std::cerr << "history: short write to spill file\n";
+            return 0;
+        }
+    }
+    // the data only has to survive this process, no need to sync.
+    fflush(f);
+    blocks.push_back(b);
+    return count;
+}
+
+int HistorySpill::page_in(int end, std::vector<Command> &out) {
+    out.clear();
+    auto it = std::find_if(blocks.begin(), blocks.end(), [&](const Block &b) {
+        return b.first + b.count == end;
+    });
+    assert(it != blocks.end() && "no spilled block ends here");
+    const Block b = *it;
+
+    int ok = fseek(f, b.offset, SEEK_SET) == 0;
+    for (int i = 0; ok && i < b.count; ++i) {
+        int n = 0;
+        ok = fread(&n, sizeof(n), 1, f) == 1;
+        Command c(n, PieceRange(0, 0, 0));
+        ok = ok && (n == 0 || fread(c.data(), sizeof(PieceRange), n, f) == (size_t)n);
+        out.push_back(std::move(c));
+    }
+    // the file is private to this process; failing to read it back means
+    // the history is gone.
+    assert(ok && "unable to read history spill file");
+    return b.first;
+}
+
+void HistorySpill::truncate(int ncmds) {
+    while (!blocks.empty() &&
+           blocks.back().first + blocks.back().count > ncmds) {
+        blocks.pop_back();
+    }
+}
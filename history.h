@@ -0,0 +1,66 @@
+#pragma once
+#include <stdio.h>
+
+#include <deque>
+#include <vector>
+
+// pieces [begin, end) of segment `seg_guid`.
+struct PieceRange {
+    int seg_guid;
+    int begin;
+    int end;
+    PieceRange(int seg_guid, int begin, int end)
+        : seg_guid(seg_guid), begin(begin), end(end){};
+    bool operator<(const PieceRange &other) const {
+        return seg_guid < other.seg_guid ||
+               (seg_guid == other.seg_guid && begin < other.begin);
+    }
+};
+
+// a command draws or erases a set of pieces, stored as disjoint ranges. A
+// stroke is a single range, an eraser pass is a handful. The pieces carry
+// the command's index as their epoch, so running or undoing a command
+// does not need the ranges. They are kept to refresh the ink index, and
+// to forget the command if history is cut.
+using Command = std::vector<PieceRange>;
+
+// sort the ranges of a finished command and merge the touching ones.
+void compact_command(Command &c);
+
+// heap bytes held by a command.
+inline size_t command_bytes(const Command &c) {
+    return sizeof(Command) + c.capacity() * sizeof(PieceRange);
+}
+
+// Old history, spilled to an anonymous append-only file.
+// Piece epochs already hold the effect of every command, so they act as
+// the checkpoint: a spilled command is only read back if the user undoes
+// that far. Commands go out in blocks, and only a small record per block
+// stays in memory.
+struct HistorySpill {
+    struct Block {
+        int first;    // index of the first command in the block.
+        int count;    // number of commands in the block.
+        long offset;  // byte offset of the block in the file.
+    };
+
+    ~HistorySpill();
+
+    // put the oldest resident commands, cmds[0] being command `first`, on
+    // disk. Writes at most `max_count` of them as a new block, or reuses the
+    // block they were paged in from, split after `max_count` if it is
+    // bigger. returns how many commands are now on disk, 0 if none (eg.
+    // the file cannot be written).
+    int spill(int first, const std::deque<Command> &cmds, int max_count);
+
+    // read back the block that ends at command `end` into `out`, oldest
+    // first. returns the index of the first command read.
+    int page_in(int end, std::vector<Command> &out);
+
+    // history was cut to [0, ncmds): forget blocks past it.
+    void truncate(int ncmds);
+
+   private:
+    FILE *f = nullptr;
+    std::vector<Block> blocks;  // ordered by `first`, contiguous from 0.
+};
@@ -0,0 +1,240 @@
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "assert.h"
+
+static const char JOURNAL_MAGIC[8] = {'W', 'A', 'R', 'D', 'J', 'R', 'N', '\0'};
+static const uint32_t JOURNAL_VERSION = 2;
+
+// CRC-32, as in zlib, of the fields of `r` before its crc.
+static uint32_t record_crc(const JournalRecord &r) {
+    static const struct Table {
+        uint32_t t[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+        }
+    } table;
+    const unsigned char *p = (const unsigned char *)&r;
+    uint32_t c = 0xffffffff;
+    for (size_t i = 0; i < offsetof(JournalRecord, crc); ++i) {
+        c = table.t[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffff;
+}
+
+std::string journal_path(const std::string &board_path, uint32_t generation) {
+    return board_path + "." + std::to_string(generation) + ".journal";
+}
+
+bool read_journal(const std::string &path, uint32_t generation,
+                  std::vector<JournalRecord> &out, long &valid_bytes) {
+    out.clear();
+    valid_bytes = 0;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    JournalHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        h.version != JOURNAL_VERSION || h.generation != generation) {
+        // a crash before the header made it: nothing was journaled yet.
+        std::cerr << "journal: ignoring " << path << ", bad header\n";
+        fclose(f);
+        return true;
+    }
+    valid_bytes = sizeof(h);
+    JournalRecord r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.crc != record_crc(r) ||
+            (r.type != JOURNAL_SEGMENT && r.type != JOURNAL_POINT &&
+             r.type != JOURNAL_VISIBILITY && r.type != JOURNAL_FIT)) {
+            std::cerr << "journal: garbage at byte " << valid_bytes << " of "
+                      << path << ", dropping the rest\n";
+            break;
+        }
+        out.push_back(r);
+        valid_bytes += sizeof(r);
+    }
+    fclose(f);
+    return true;
+}
+
+// open journal `path`, truncated to `keep_bytes`, for appending. -1 on
+// failure.
+static int open_journal_file(const std::string &path, uint32_t generation,
+                             long keep_bytes) {
+    const int fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | (keep_bytes ? 0 : O_TRUNC),
+               0644);
+    if (fd == -1) {
+        std::cerr << "journal: unable to open " << path << ": "
+                  << strerror(errno) << "\n";
+        return -1;
+    }
+    if (keep_bytes) {
+        // drop a torn record, appends go right after the last good one.
+        if (ftruncate(fd, keep_bytes) != 0 ||
+            lseek(fd, keep_bytes, SEEK_SET) != keep_bytes) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    JournalHeader h;
+    memcpy(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    h.version = JOURNAL_VERSION;
+    h.generation = generation;
+    if (write(fd, &h, sizeof(h)) != sizeof(h) || fdatasync(fd) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Journal::~Journal() { close(); }
+
+bool Journal::open(const std::string &path, uint32_t generation,
+                   long keep_bytes) {
+    assert(!opened && "journal already open");
+    fd = open_journal_file(path, generation, keep_bytes);
+    if (fd == -1) {
+        return false;
+    }
+    opened = true;
+    gen = fd_gen = generation;
+    nbytes = 0;
+    stopping = false;
+    writer = std::thread(&Journal::writer_loop, this);
+    return true;
+}
+
+bool Journal::rotate(const std::string &path) {
+    assert(opened);
+    std::lock_guard<std::mutex> lock(mu);
+    // the writer has not created the journal of the last rotation yet.
+    if (rotating) {
+        return false;
+    }
+    rotating = true;
+    sealed.swap(pending);
+    rotate_path = path;
+    gen++;
+    nbytes = 0;
+    wake.notify_one();
+    return true;
+}
+
+void Journal::close() {
+    if (!opened) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        stopping = true;
+        wake.notify_one();
+    }
+    writer.join();
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    opened = false;
+}
+
+bool Journal::write_all(int fd, const void *p, size_t n) {
+    const char *c = (const char *)p;
+    while (n > 0) {
+        const ssize_t w = write(fd, c, n);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return false;
+        }
+        c += w;
+        n -= w;
+    }
+    return true;
+}
+
+void Journal::writer_loop() {
+    std::vector<JournalRecord> batch, sealed_batch;
+    std::string next_path;
+    // the rotation being done: its journal is not created yet.
+    bool in_rotation = false;
+    auto write_batch = [](int fd, std::vector<JournalRecord> &b) {
+        for (JournalRecord &r : b) {
+            r.crc = record_crc(r);
+        }
+        if (!write_all(fd, b.data(), b.size() * sizeof(JournalRecord)) ||
+            fdatasync(fd) != 0) {
+            std::cerr << "journal: write failed: " << strerror(errno)
+                      << "\n";
+        }
+        b.clear();
+    };
+    for (;;) {
+        bool stop, sealed_now = false;
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            wake.wait_for(lock, std::chrono::milliseconds(JOURNAL_FLUSH_MS),
+                          [&] { return stopping || (rotating && !in_rotation); });
+            if (rotating && !in_rotation) {
+                sealed_batch.swap(sealed);
+                next_path = rotate_path;
+                in_rotation = sealed_now = true;
+            }
+            // a batch kept back while the next journal could not be
+            // created goes first.
+            batch.insert(batch.end(), pending.begin(), pending.end());
+            pending.clear();
+            stop = stopping;
+        }
+
+        // older records first: a crash can only lose a suffix.
+        if (sealed_now) {
+            write_batch(fd, sealed_batch);
+            ::close(fd);
+            fd = -1;
+        }
+        if (in_rotation) {
+            fd = open_journal_file(next_path, fd_gen + 1, 0);
+            if (fd != -1) {
+                fd_gen++;
+                in_rotation = false;
+                std::lock_guard<std::mutex> lock(mu);
+                rotating = false;
+            } else {
+                std::cerr << "journal: keeping " << batch.size()
+                          << " records in memory until " << next_path
+                          << " can be created\n";
+            }
+        }
+        if (fd != -1 && !batch.empty()) {
+            write_batch(fd, batch);
+        }
+        if (stop) {
+            if (!batch.empty()) {
+                std::cerr << "journal: lost " << batch.size()
+                          << " records, " << next_path
+                          << " could not be created\n";
+            }
+            return;
+        }
+    }
+}
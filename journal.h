@@ -0,0 +1,115 @@
+#pragma once
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only journal of board changes since the last snapshot.
+// The render thread appends records to a buffer. A writer thread takes
+// the buffer every JOURNAL_FLUSH_MS, writes it with one write() and
+// fdatasync()s it: a crash loses at most that interval of drawing, and a
+// frame never waits on the disk. The writer also creates the next journal
+// when the journal is rotated.
+//
+// Every record carries a CRC of its fields. Replay stops at the first
+// record whose CRC does not match: a torn tail that happens to parse is
+// dropped, not replayed.
+//
+// Records describe effects, not commands, so replaying them does not need
+// the undo history that produced them: a point appended to a segment, a
+// finished segment fit with curves, or a run of pieces turning visible or
+// invisible.
+//
+// Journals are numbered by generation. A snapshot stores the generation
+// of the journal that follows it, so a journal that the snapshot already
+// covers is never replayed.
+
+enum JournalRecordType {
+    JOURNAL_SEGMENT = 1,     // new segment `seg`, color (a, b, c).
+    JOURNAL_POINT = 2,       // point (a, b) appended to segment `seg`.
+    JOURNAL_VISIBILITY = 3,  // pieces [a, b) of `seg` shown if c, else hidden.
+    JOURNAL_FIT = 4,         // segment `seg` finished, and fit with curves.
+};
+
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t generation;
+};
+
+struct JournalRecord {
+    int32_t type;
+    int32_t seg;
+    int32_t a, b, c;
+    uint32_t crc;  // of the fields above, filled in by the writer.
+};
+
+static const int JOURNAL_FLUSH_MS = 200;
+
+// "<board path>.<generation>.journal"
+std::string journal_path(const std::string &board_path, uint32_t generation);
+
+// read the records of journal `path` that were completely written. false
+// if there is no such journal. `valid_bytes` is where the next record
+// belongs: anything after it is a torn write.
+bool read_journal(const std::string &path, uint32_t generation,
+                  std::vector<JournalRecord> &out, long &valid_bytes);
+
+struct Journal {
+    ~Journal();
+
+    // start appending to journal `path`, keeping its first `keep_bytes`
+    // (0: start a new journal). Starts the writer thread.
+    bool open(const std::string &path, uint32_t generation, long keep_bytes);
+    bool is_open() const { return opened; }
+    uint32_t generation() const { return gen; }
+    // bytes appended since the journal was opened or rotated.
+    long size() const { return nbytes; }
+
+    // does nothing if the journal is not open.
+    void append(const JournalRecord &r) {
+        if (!opened) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mu);
+        pending.push_back(r);
+        nbytes += sizeof(r);
+    }
+
+    // records from now on go to journal `path`, generation + 1. Records
+    // appended so far are still written to the old journal, first. The
+    // writer creates the new journal. Until it manages to, it keeps the
+    // new records in memory and tries again every flush. false if the last
+    // rotation is still being written.
+    bool rotate(const std::string &path);
+
+    // write out everything and stop the writer thread.
+    void close();
+
+   private:
+    void writer_loop();
+    static bool write_all(int fd, const void *p, size_t n);
+
+    // render thread.
+    bool opened = false;
+    uint32_t gen = 0;
+    long nbytes = 0;
+
+    // the writer's.
+    int fd = -1;
+    uint32_t fd_gen = 0;
+
+    std::mutex mu;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<JournalRecord> pending;  // not yet handed to the writer.
+    // a rotation the writer has yet to do: the records that still belong
+    // to the old journal, and the path of the new one.
+    bool rotating = false;
+    std::vector<JournalRecord> sealed;
+    std::string rotate_path;
+    std::thread writer;
+};
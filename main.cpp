@@ -5,6 +5,16 @@
 #include <SDL_surface.h>
 #include <SDL_video.h>
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #define EASYTAB_IMPLEMENTATION
 #include <SDL2/SDL.h>
@@ -15,12 +25,22 @@
 #include <map>
 #include <optional>
 #include <set>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "assert.h"
+#include "board.h"
+#include "curve-fit.h"
 #include "easytab.h"
+#include "history.h"
+#include "journal.h"
+#include "overview.h"
+#include "packed-points.h"
+#include "pen-predict.h"
+#include "quadtree.h"
+#include "spatial-hash.h"
+#include "stream.h"
+#include "stroke-filter.h"
+#include "tablet.h"
 #include "vector-graphics.h"
 
 // TODO: fix zoom and scroll!
@@ -31,6 +51,31 @@ using namespace std;
 
 // CONFIG
 static const int PEN_RADIUS = 10;
+static const int TARGET_FPS = 30;
+
+// undo history held in memory before old commands spill to disk.
+// override with WARD_HISTORY_BUDGET_MB.
+size_t g_history_budget_bytes = 64 << 20;
+// recent commands that never spill, however tight the budget.
+static const int HISTORY_KEEP_RESIDENT = 256;
+// roughly how much history goes to disk at a time.
+static const size_t HISTORY_SPILL_BLOCK_BYTES = 1 << 20;
+// memory for the loaded board's points near the viewport. override with
+// WARD_STREAM_BUDGET_MB.
+size_t g_stream_budget_bytes = (size_t)1 << 30;
+// VGFlags to draw with. WARD_DEPTH_STROKES=1 adds VG_DEPTH_STROKES.
+int g_vg_flags = 0;
+// samples per pixel to draw with, or 0 for nanovg's own antialiasing.
+// override with WARD_MSAA.
+int g_msaa_samples = 0;
+// with WARD_BENCH_FRAMES, draw the board that many times, report the time
+// per frame, and quit.
+int g_bench_frames = 0;
+// journal size that triggers a new snapshot of the board.
+static const long JOURNAL_COMPACT_BYTES = 64 << 20;
+// PEN_RADIUS is handed to nanovg as the stroke width, so ink reaches half
+// of it away from the centre line.
+static const int PEN_HALF_WIDTH = PEN_RADIUS / 2;
 
 static const int MIN_ERASER_RADIUS = 30;
 static const int MAX_ERASER_RADIUS = 100;
@@ -67,17 +112,106 @@ int PALETTE_HEIGHT() { return SCREEN_HEIGHT / 20; }
 using ll = long long;
 using ll = long long;
 
+// epoch of a piece that was never erased, or was never really drawn.
+static const int EPOCH_NEVER = INT_MAX;
+
+// strokes are indexed for range queries in chunks of CHUNK_PIECES line
+// pieces. chunk k of a segment covers pieces [k * CHUNK_PIECES, (k + 1) *
+// CHUNK_PIECES), so its last point is the first point of the next chunk.
+static const int CHUNK_PIECES = 32;
+
+// where a segment's points are.
+enum SegmentStorage : uint8_t {
+    SEGMENT_RAW,     // being drawn: plain points in g_arena.
+    SEGMENT_PACKED,  // finished: packed points in g_arena.
+    SEGMENT_MAPPED,  // loaded: plain points in the mapped board.
+};
+
+// A segment is a fixed-size header. Its points, handles and piece epochs
+// live in columns shared by all segments: g_arena for segments drawn this
+// session, the mapped board for loaded ones.
+// piece i is the cubic Bézier from point(i) to point(i + 1), with the two
+// handles handles_in() gives for it. A piece with its handles on its knots is
+// a straight line. it was drawn by command created(i) and erased by command
+// erased(i), so it shows exactly when created(i) <= runtill < erased(i).
+// Undo and redo only move the commander's runtill.
 struct Segment {
-    ll guid;
-    vector<V2<int>> points;
-    vector<bool> visible;
-    Color color;
-    Segment(){};
+    // RAW and MAPPED: index of the first point in the point column.
+    // PACKED: index of the first block in g_arena.blocks. the blocks of
+    // the handles follow those of the points.
+    int64_t first_point = 0;
+    // RAW: index of the first piece in g_arena.handles. MAPPED: in the
+    // handle and epoch columns of the board.
+    int64_t first_piece = 0;
+    int npoints = 0;
+    // the chunks of a segment have consecutive ids, from first_chunk.
+    int first_chunk = -1;
+    Box bounds;  // of every point.
+    uint8_t colorix = 0;
+    uint8_t storage = SEGMENT_RAW;
+
+    int npieces() const { return max(0, npoints - 1); }
+    int nchunks() const {
+        return (npieces() + CHUNK_PIECES - 1) / CHUNK_PIECES;
+    }
+    Color color() const { return g_palette[colorix]; }
+
+    int created(int piece) const;
+    int erased(int piece) const;
+    void set_epochs(int piece, int created, int erased);
+    // the handles of pieces [begin, end), two per piece, decoded into
+    // `scratch` if the segment is packed.
+    const V2<int> *handles_in(int begin, int end,
+                              vector<V2<int>> &scratch) const;
+    bool visible(int piece, int runtill) const {
+        return created(piece) <= runtill && runtill < erased(piece);
+    }
+
+    V2<int> point(int i) const;
+    // points [begin, end), decoded into `scratch` if the segment is packed.
+    const V2<int> *points_in(int begin, int end,
+                             vector<V2<int>> &scratch) const;
+};
+
+// epochs of the pieces of a chunk. A chunk is drawn by one command, and
+// most are never erased, or erased whole: then all its pieces share the
+// epochs here. Once they differ, the chunk gets a detail block of
+// CHUNK_PIECES epochs each in g_arena.detail_created and detail_erased.
+struct EpochChunk {
+    int created;
+    int erased;
+    int detail = -1;  // block index, or -1.
 };
 
+// Columns of the segments drawn this session.
+// Only the last segment ever grows, so the range of every segment stays
+// contiguous. Raw points are only kept for the segment being drawn: the
+// points of a finished stroke are packed, and the raw tail is reused.
+struct SegmentArena {
+    vector<V2<int>> points;
+    vector<uint8_t> packed;
+    vector<uint64_t> blocks;
+    // epochs of chunk k are at epochs[k - first_chunk]: the chunks of the
+    // loaded board come first, and keep their epochs in the board.
+    int first_chunk = 0;
+    vector<EpochChunk> epochs;
+    vector<int> detail_created;
+    vector<int> detail_erased;
+    // handles of the pieces of the raw segment.
+    vector<V2<int>> handles;
+} g_arena;
+
 struct CurveState {
     bool is_down = false;
     int seg_guid;
+    // what is kept of the samples of the stroke being drawn.
+    StrokeFilter filter;
+    vector<V2<int>> filtered;
+    // where the pen is headed. only drawn, never part of the stroke.
+    PenPredictor predictor;
+    // clock of the samples minus SDL_GetTicks(), as of the last sample.
+    // samples wait up to a frame to be handled, so it errs late by that.
+    uint32_t clock_offset = 0;
 } g_curvestate;
 
 V2<int> g_penstate;
@@ -95,9 +229,17 @@ struct ColorState {
     int eraser_radius = -1;  // radius of the eraser based on pressure.
 } g_colorstate;
 
+struct EraserState {
+    // previous eraser position in this stroke, in world coordinates.
+    bool has_last = false;
+    V2<int> last;
+    // path not yet erased.
+    Sweep sweep;
+    // scratch: pieces erased by the current flush.
+    vector<SegPointGuid> erased;
+} g_eraserstate;
+
 struct OverviewState {
-    V2<int> minPos;
-    V2<int> maxPos;
     V2<int> saved_pan;
     bool overviewing = false;
 } g_overviewstate;
@@ -107,164 +249,1174 @@ struct RenderState {
     V2<int> pan;
 } g_renderstate;
 
+// The board is drawn into the layer, and shown from there. A pan only
+// scrolls the layer on the GPU and draws the strips it exposes, so a pan
+// costs as much as it is fast, not as much as the board is big. Changed
+// ink only draws the part of the layer it is in.
+struct ScrollState {
+    bool usable = true;  // false without framebuffer objects.
+    // the layer shows the board at pan and zoom, on a w x h window.
+    bool valid = false;
+    V2<int> pan;
+    float zoom = 1;
+    int w = 0, h = 0;
+    long loads = 0;  // regions streamed in when it was drawn.
+    // world box of the ink changed since.
+    Box damage;
+} g_scrollstate;
+
+// Parts of the window that changed, so that a frame only draws those, and
+// a frame where nothing changed is not drawn at all. The back buffer holds
+// the frame from `age` swaps ago, so a frame draws what changed in it and
+// in the age - 1 frames before.
+static const int DAMAGE_HISTORY = 4;
+struct DamageState {
+    // the next frame is drawn in full.
+    bool redraw = true;
+    // screen box of what changed this frame.
+    Box frame;
+    // of the frames before, newest first.
+    Box history[DAMAGE_HISTORY];
+    // the overlays as last drawn.
+    Box tail, eraser;
+    int palette = -2;  // see damage_overlays().
+} g_damagestate;
+
 std::vector<Segment> g_segments;
 
-// https://stackoverflow.com/a/54945214/5305365
-struct hash_pair_int {
-    size_t operator()(const pair<int, int> &pi) const {
-        return std::hash<int>()(pi.first) * 31 + std::hash<int>()(pi.second);
-    };
-};
+// board being edited. its segments come first in g_segments.
+const char *g_board_path = "board.ward";
+MappedBoard g_board;
 
-// value stored into the spatial hash
-struct SegPointGuid {
-    int seg_guid;    // guid of segment.
-    int point_guid;  // guid of point stored in segment.
+// epochs of the chunk holding `piece` of arena segment `s`.
+static EpochChunk &epoch_chunk(const Segment &s, int piece) {
+    assert(s.storage != SEGMENT_MAPPED && s.first_chunk >= 0);
+    return g_arena.epochs[s.first_chunk + piece / CHUNK_PIECES -
+                          g_arena.first_chunk];
+}
 
-    bool operator<(const SegPointGuid &other) const {
-        return make_pair(seg_guid, point_guid) <
-               make_pair(other.seg_guid, other.point_guid);
+int Segment::created(int piece) const {
+    assert(0 <= piece && piece < npieces());
+    if (storage == SEGMENT_MAPPED) {
+        return g_board.created[first_piece + piece];
     }
+    const EpochChunk &e = epoch_chunk(*this, piece);
+    return e.detail < 0 ? e.created
+                        : g_arena.detail_created[e.detail * CHUNK_PIECES +
+                                                 piece % CHUNK_PIECES];
+}
 
-    bool operator==(const SegPointGuid &other) const {
-        return make_pair(seg_guid, point_guid) ==
-               make_pair(other.seg_guid, other.point_guid);
+int Segment::erased(int piece) const {
+    assert(0 <= piece && piece < npieces());
+    if (storage == SEGMENT_MAPPED) {
+        return g_board.erased[first_piece + piece];
     }
+    const EpochChunk &e = epoch_chunk(*this, piece);
+    return e.detail < 0 ? e.erased
+                        : g_arena.detail_erased[e.detail * CHUNK_PIECES +
+                                                piece % CHUNK_PIECES];
+}
 
-    SegPointGuid() : seg_guid(-1), point_guid(-1){};
-    SegPointGuid(int seg_guid, int point_guid)
-        : seg_guid(seg_guid), point_guid(point_guid){};
-};
+void Segment::set_epochs(int piece, int created, int erased) {
+    assert(0 <= piece && piece < npieces());
+    if (storage == SEGMENT_MAPPED) {
+        g_board.created[first_piece + piece] = created;
+        g_board.erased[first_piece + piece] = erased;
+        return;
+    }
+    EpochChunk &e = epoch_chunk(*this, piece);
+    if (e.detail < 0) {
+        if (created == e.created && erased == e.erased) {
+            return;
+        }
+        // blocks are not reclaimed: partly erased chunks are few.
+        e.detail = g_arena.detail_created.size() / CHUNK_PIECES;
+        g_arena.detail_created.resize(
+            g_arena.detail_created.size() + CHUNK_PIECES, e.created);
+        g_arena.detail_erased.resize(
+            g_arena.detail_erased.size() + CHUNK_PIECES, e.erased);
+    }
+    g_arena.detail_created[e.detail * CHUNK_PIECES + piece % CHUNK_PIECES] =
+        created;
+    g_arena.detail_erased[e.detail * CHUNK_PIECES + piece % CHUNK_PIECES] =
+        erased;
+}
 
-struct hash_spatial_hash_value {
-    size_t operator()(const SegPointGuid &v) const {
-        return std::hash<int>()(v.point_guid) * 31 +
-               std::hash<int>()(v.seg_guid);
-    };
-};
+const V2<int> *Segment::handles_in(int begin, int end,
+                                   vector<V2<int>> &scratch) const {
+    assert(0 <= begin && begin <= end && end <= npieces());
+    switch (storage) {
+        case SEGMENT_RAW:
+            return g_arena.handles.data() + 2 * (first_piece + begin);
+        case SEGMENT_MAPPED:
+            return g_board.handles + 2 * (first_piece + begin);
+    }
+    // handles are packed like points: consecutive ones are close, on
+    // either side of a knot or of a short piece.
+    const int64_t first_block = first_point + (npoints + PACK_BLOCK - 1) /
+                                                  PACK_BLOCK;
+    scratch.resize(2 * (end - begin));
+    unpack_points(g_arena.packed.data(), g_arena.blocks.data() + first_block,
+                  2 * begin, 2 * end, scratch.data());
+    return scratch.data();
+}
+
+V2<int> Segment::point(int i) const {
+    assert(0 <= i && i < npoints);
+    switch (storage) {
+        case SEGMENT_RAW:
+            return g_arena.points[first_point + i];
+        case SEGMENT_MAPPED:
+            return g_board.points[first_point + i];
+    }
+    V2<int> p;
+    unpack_points(g_arena.packed.data(), g_arena.blocks.data() + first_point,
+                  i, i + 1, &p);
+    return p;
+}
+
+const V2<int> *Segment::points_in(int begin, int end,
+                                  vector<V2<int>> &scratch) const {
+    assert(0 <= begin && begin <= end && end <= npoints);
+    switch (storage) {
+        case SEGMENT_RAW:
+            return g_arena.points.data() + first_point + begin;
+        case SEGMENT_MAPPED:
+            return g_board.points + first_point + begin;
+    }
+    scratch.resize(end - begin);
+    unpack_points(g_arena.packed.data(), g_arena.blocks.data() + first_point,
+                  begin, end, scratch.data());
+    return scratch.data();
+}
+
+// the stroke `s` is finished and will never grow: pack its points and
+// handles.
+void pack_segment(Segment &s) {
+    if (s.storage != SEGMENT_RAW) {
+        return;
+    }
+    // the one raw segment is the tail of the arena.
+    assert(s.first_point + s.npoints == g_arena.points.size());
+    const int64_t first_block = g_arena.blocks.size();
+    assert(2 * (s.first_piece + s.npieces()) == g_arena.handles.size());
+    pack_points(g_arena.points.data() + s.first_point, s.npoints,
+                g_arena.packed, g_arena.blocks);
+    pack_points(g_arena.handles.data() + 2 * s.first_piece, 2 * s.npieces(),
+                g_arena.packed, g_arena.blocks);
+    g_arena.points.resize(s.first_point);
+    g_arena.handles.resize(2 * s.first_piece);
+    s.first_point = first_block;
+    s.storage = SEGMENT_PACKED;
+}
+
+// palette entry of color (r, g, b). colors only ever come from the
+// palette, so anything else falls back to the first one.
+int palette_index(int r, int g, int b) {
+    for (int i = 0; i < g_palette.size(); ++i) {
+        if (g_palette[i].r == r && g_palette[i].g == g && g_palette[i].b == b) {
+            return i;
+        }
+    }
+    return 0;
+}
 
-// a key into the spatial hash is coordinates.
-using SpatialHashKey = pair<int, int>;
+// pages the loaded board in and out around the viewport.
+RegionStreamer g_streamer;
+// changes to the board since its snapshot.
+Journal g_journal;
+// journal the board file on disk is followed by.
+uint32_t g_snapshot_generation = 0;
+// the child writing a snapshot, or -1.
+pid_t g_compaction_pid = -1;
+uint32_t g_compaction_generation = 0;
 
 // TODO: order the Stroke indexes
 // by insertion time, so we paint in the right
 // order.
-static const int HASH_CELL_SZ = 1000;
-unordered_map<pair<int, int>,
-              unordered_set<SegPointGuid, hash_spatial_hash_value>,
-              hash_pair_int>
-    g_spatial_hash;
+// small cells: an eraser of radius <= MAX_ERASER_RADIUS touches at most
+// 3x3 cells, and a cell holds few enough pieces to scan linearly.
+static const int HASH_CELL_SZ = 128;
+SpatialHash g_spatial_hash(HASH_CELL_SZ);
 
-// returns true if point was added.
+// the spatial hash stores line pieces, see `SegPointGuid`.
 void add_to_spatial_hash(SegPointGuid value) {
     const Segment &s = g_segments[value.seg_guid];
-    const V2<int> point = s.points[value.point_guid];
-    const int sx = point.x / HASH_CELL_SZ;
-    int sy = point.y / HASH_CELL_SZ;
-    unordered_set<SegPointGuid, hash_spatial_hash_value> &bucket =
-        g_spatial_hash[make_pair(sx, sy)];
-    auto it = bucket.find(value);
-    assert(it == bucket.end());
-    bucket.insert(value);
+    g_spatial_hash.insert(s.point(value.point_guid),
+                          s.point(value.point_guid + 1), value);
 }
 
 void remove_from_spatial_hash(SegPointGuid value) {
     const Segment &s = g_segments[value.seg_guid];
-    const V2<int> point = s.points[value.point_guid];
-    const int sx = point.x / HASH_CELL_SZ;
-    int sy = point.y / HASH_CELL_SZ;
-    unordered_set<SegPointGuid, hash_spatial_hash_value> &bucket =
-        g_spatial_hash[make_pair(sx, sy)];
-    auto it = bucket.find(value);
-    assert(it != bucket.end());
-    bucket.erase(it);
+    g_spatial_hash.remove(s.point(value.point_guid),
+                          s.point(value.point_guid + 1), value);
 }
 
-using Command = vector<SegPointGuid>;
-
-void run_command(const Command &c) {
-    for (const SegPointGuid &v : c) {
-        assert(v.seg_guid < g_segments.size());
-        Segment &s = g_segments[v.seg_guid];
-        assert(v.point_guid < s.visible.size());
-        s.visible[v.point_guid] = !s.visible[v.point_guid];
-
-        if (s.visible[v.point_guid]) {
-        }
-    }
-};
+// the pieces of `c` changed visibility: refresh their chunks, and journal
+// the change.
+void refresh_command_chunks(const Command &c);
+// command `epoch` is dropped from history for good.
+void discard_command(int epoch, const Command &c);
 
 struct Commander {
-    vector<Command> cmds;
+    // commands [base, ncmds()) are resident, older ones are spilled.
+    deque<Command> cmds;
+    int base = 0;
+    HistorySpill spill;
+    // bytes held by resident commands.
+    size_t resident_bytes = 0;
     // have run commands till index
     int runtill = -1;
 
+    int ncmds() const { return base + cmds.size(); }
+    Command &cmd(int k) {
+        assert(base <= k && k < ncmds());
+        return cmds[k - base];
+    }
+
     void undo() {
         std::cerr << "trying to undo...\n";
         if (runtill < 0) {
             return;
         }
         std::cerr << "\tundoing\n";
-        assert(runtill < cmds.size());
-        run_command(cmds[runtill]);
+        assert(runtill < ncmds());
+        if (runtill < base) {
+            page_in();
+        }
         runtill--;
         assert(runtill >= -1);
+        refresh_command_chunks(cmd(runtill + 1));
     }
 
     void redo() {
         // nothing to redo.
-        if (runtill == cmds.size() - 1) {
+        if (runtill == ncmds() - 1) {
             return;
         }
         std::cerr << "redoing command!\n";
-        run_command(cmds[runtill + 1]);
         runtill++;
+        refresh_command_chunks(cmd(runtill));
     }
 
     void start_new_command() {
-        // TODO: can ask segments to fixup data if too damaged.
-        // What is the heuristic? Need some kind of amortized
-        // analysis to decide when to resize a segment
-        // that is changed too much.
         // if we have more commands, drop extra commands.
-        if (this->runtill != cmds.size() - 1) {
+        if (this->runtill != ncmds() - 1) {
             // keep [0, ..., undoix]
             // eg. undoix=0 => resize[0..0]
-            cmds.resize(this->runtill + 1);
+            // undo pages commands in before running past them.
+            assert(this->runtill + 1 >= base);
+            for (int k = this->runtill + 1; k < ncmds(); ++k) {
+                discard_command(k, cmd(k));
+                resident_bytes -= command_bytes(cmd(k));
+            }
+            cmds.resize(this->runtill + 1 - base);
+            spill.truncate(ncmds());
         }
 
-        assert(this->runtill == this->cmds.size() - 1);
+        assert(this->runtill == ncmds() - 1);
+        if (!this->cmds.empty()) {
+            resident_bytes -= command_bytes(this->cmds.back());
+            compact_command(this->cmds.back());
+            resident_bytes += command_bytes(this->cmds.back());
+        }
+        if (resident_bytes > g_history_budget_bytes) {
+            spill_old_commands();
+        }
         this->cmds.push_back({});
-        this->runtill = this->cmds.size() - 1;
+        resident_bytes += command_bytes(this->cmds.back());
+        this->runtill = ncmds() - 1;
     }
 
     void add_to_command(SegPointGuid v) {
-        assert(this->runtill == this->cmds.size() - 1);
+        assert(this->runtill == ncmds() - 1);
         assert(this->cmds.size() >= 0);
-        this->cmds[this->runtill].push_back(v);
+        Command &c = cmd(this->runtill);
+        // strokes append pieces in order: grow the last range.
+        if (!c.empty() && c.back().seg_guid == v.seg_guid &&
+            c.back().end == v.point_guid) {
+            c.back().end++;
+            return;
+        }
+        resident_bytes -= command_bytes(c);
+        c.push_back(PieceRange(v.seg_guid, v.point_guid, v.point_guid + 1));
+        resident_bytes += command_bytes(c);
+    }
+
+    const Command &getCommand() {
+        assert(this->runtill == ncmds() - 1);
+        assert(ncmds() > 0);
+        return cmd(this->runtill);
+    }
+
+   private:
+    // move the oldest commands to disk until we are well under budget.
+    // the most recent HISTORY_KEEP_RESIDENT commands always stay, so
+    // ordinary undo/redo never touches the disk.
+    void spill_old_commands() {
+        while (resident_bytes > g_history_budget_bytes / 4 * 3 &&
+               (int)cmds.size() > HISTORY_KEEP_RESIDENT) {
+            int n = 0;
+            size_t bytes = 0;
+            const int max_n = cmds.size() - HISTORY_KEEP_RESIDENT;
+            while (n < max_n && bytes < HISTORY_SPILL_BLOCK_BYTES) {
+                bytes += command_bytes(cmds[n]);
+                n++;
+            }
+            n = spill.spill(base, cmds, n);
+            if (n == 0) {
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                resident_bytes -= command_bytes(cmds.front());
+                cmds.pop_front();
+            }
+            base += n;
+        }
     }
 
-    const Command &getCommand() const {
-        assert(this->runtill == this->cmds.size() - 1);
-        assert(this->cmds.size() > 0);
-        return this->cmds[this->runtill];
+    // bring back the spilled block just before `base`.
+    void page_in() {
+        static vector<Command> block;
+        const int first = spill.page_in(base, block);
+        assert(first + (int)block.size() == base);
+        for (int i = block.size() - 1; i >= 0; --i) {
+            resident_bytes += command_bytes(block[i]);
+            cmds.push_front(std::move(block[i]));
+        }
+        base = first;
     }
 
 } g_commander;
 
-void draw_pen_strokes_cr() {
+bool piece_visible(const Segment &s, int piece) {
+    return s.visible(piece, g_commander.runtill);
+}
+
+struct Chunk {
+    int seg_guid;
+    int begin;  // first piece in the chunk.
+};
+// chunk ids are handed out in drawing order, so sorting by id gives paint
+// order.
+vector<Chunk> g_chunks;
+Quadtree g_ink_index;
+vector<int> g_dirty_chunks;
+// the board as drawn in the overview.
+OverviewPyramid g_overview_pyramid;
+// tiles of the pyramid brought up to date per frame outside the overview,
+// and in it, where tiles not redrawn yet show their old ink meanwhile.
+static const int OVERVIEW_TILES_PER_FRAME = 4;
+static const int OVERVIEW_TILES_PER_OVERVIEW_FRAME = 32;
+
+// the ink of world box `b` may have changed.
+void invalidate_ink(const Box &b) {
+    if (b.empty()) {
+        return;
+    }
+    const Box ink(b.lo - V2<int>(PEN_HALF_WIDTH, PEN_HALF_WIDTH),
+                  b.hi + V2<int>(PEN_HALF_WIDTH, PEN_HALF_WIDTH));
+    g_scrollstate.damage.add(ink);
+    g_overview_pyramid.invalidate(ink);
+}
+
+// bounds: every point and handle of the chunk. ink: every point and
+// handle of a visible piece. a piece lies within the box of its handles.
+// `scratch` and `handle_scratch` hold the chunk's points and handles if
+// the segment is packed.
+void compute_chunk_boxes(const Chunk &c, Box &bounds, Box &ink,
+                         vector<V2<int>> &scratch,
+                         vector<V2<int>> &handle_scratch) {
+    const Segment &s = g_segments[c.seg_guid];
+    const int end = min<int>(c.begin + CHUNK_PIECES, s.npieces());
+    // pts[i] is point c.begin + i, hs[2 * i] its first handle.
+    const V2<int> *pts = s.points_in(c.begin, end + 1, scratch);
+    const V2<int> *hs = s.handles_in(c.begin, end, handle_scratch);
+    bounds.add(pts[0]);
+    for (int i = c.begin; i < end; ++i) {
+        const int j = i - c.begin;
+        bounds.add(pts[j + 1]);
+        bounds.add(hs[2 * j]);
+        bounds.add(hs[2 * j + 1]);
+        if (piece_visible(s, i)) {
+            ink.add(pts[j]);
+            ink.add(pts[j + 1]);
+            ink.add(hs[2 * j]);
+            ink.add(hs[2 * j + 1]);
+        }
+    }
+}
+
+void refresh_chunk(int chunk_id) {
+    static vector<V2<int>> scratch, handle_scratch;
+    Box bounds, ink;
+    compute_chunk_boxes(g_chunks[chunk_id], bounds, ink, scratch,
+                        handle_scratch);
+    // bounds hold the ink before and after.
+    invalidate_ink(bounds);
+    if (g_ink_index.contains(chunk_id)) {
+        g_ink_index.update(chunk_id, bounds, ink);
+    } else {
+        g_ink_index.insert(chunk_id, bounds, ink);
+    }
+}
+
+// a piece was appended to segment `seg_guid`: create or grow its chunk.
+void index_appended_piece(int seg_guid) {
+    Segment &s = g_segments[seg_guid];
+    const int piece = s.npieces() - 1;
+    const int k = piece / CHUNK_PIECES;
+    if (piece % CHUNK_PIECES == 0) {
+        if (k == 0) {
+            s.first_chunk = g_chunks.size();
+        }
+        assert(s.first_chunk + k == g_chunks.size() &&
+               "only the last segment grows");
+        Chunk c;
+        c.seg_guid = seg_guid;
+        c.begin = k * CHUNK_PIECES;
+        g_chunks.push_back(c);
+    }
+    refresh_chunk(s.first_chunk + k);
+}
+
+// visibility of piece `v` changed; fixed up by the next flush.
+void mark_chunk_dirty(SegPointGuid v) {
+    const Segment &s = g_segments[v.seg_guid];
+    g_dirty_chunks.push_back(s.first_chunk + v.point_guid / CHUNK_PIECES);
+}
+
+// visibility of pieces [begin, end) of `seg_guid` changed.
+void mark_chunks_dirty(int seg_guid, int begin, int end) {
+    const Segment &s = g_segments[seg_guid];
+    for (int k = begin / CHUNK_PIECES; k <= (end - 1) / CHUNK_PIECES; ++k) {
+        g_dirty_chunks.push_back(s.first_chunk + k);
+    }
+}
+
+void flush_dirty_chunks() {
+    sort(g_dirty_chunks.begin(), g_dirty_chunks.end());
+    g_dirty_chunks.erase(unique(g_dirty_chunks.begin(), g_dirty_chunks.end()),
+                         g_dirty_chunks.end());
+    for (int c : g_dirty_chunks) {
+        refresh_chunk(c);
+    }
+    g_dirty_chunks.clear();
+}
+
+// journal the visibility of pieces [begin, end) of `seg_guid`, one record
+// per run.
+void journal_visibility(int seg_guid, int begin, int end) {
+    const Segment &s = g_segments[seg_guid];
+    for (int l = begin; l < end;) {
+        const bool visible = piece_visible(s, l);
+        int r = l + 1;
+        while (r < end && piece_visible(s, r) == visible) {
+            r++;
+        }
+        JournalRecord rec;
+        rec.type = JOURNAL_VISIBILITY;
+        rec.seg = seg_guid;
+        rec.a = l;
+        rec.b = r;
+        rec.c = visible;
+        g_journal.append(rec);
+        l = r;
+    }
+}
+
+void refresh_command_chunks(const Command &c) {
+    for (const PieceRange &r : c) {
+        mark_chunks_dirty(r.seg_guid, r.begin, r.end);
+        journal_visibility(r.seg_guid, r.begin, r.end);
+    }
+    flush_dirty_chunks();
+}
+
+// start a segment of palette color `colorix`, returning its guid.
+int new_segment(int colorix) {
+    // the previous stroke is finished by now.
+    if (!g_segments.empty()) {
+        pack_segment(g_segments.back());
+    }
+    const int seg_guid = g_segments.size();
+    g_segments.push_back(Segment());
+    Segment &s = g_segments.back();
+    s.first_point = g_arena.points.size();
+    s.first_piece = g_arena.handles.size() / 2;
+    s.colorix = colorix;
+    JournalRecord rec;
+    rec.type = JOURNAL_SEGMENT;
+    rec.seg = seg_guid;
+    rec.a = s.color().r;
+    rec.b = s.color().g;
+    rec.c = s.color().b;
+    g_journal.append(rec);
+    return seg_guid;
+}
+
+// append `p` to segment `seg_guid`, joined by the cubic with handles h1
+// and h2 (unused for the first point). returns whether this made a piece,
+// which shows from command `epoch` on. Not journaled.
+bool push_point(int seg_guid, V2<int> p, V2<int> h1, V2<int> h2, int epoch) {
+    Segment &s = g_segments[seg_guid];
+    assert(s.storage == SEGMENT_RAW && "finished strokes do not grow");
+    assert(seg_guid + 1 == g_segments.size() && "only the last segment grows");
+    g_arena.points.push_back(p);
+    s.npoints++;
+    s.bounds.add(p);
+    // the first point has no piece to draw yet.
+    if (s.npoints < 2) {
+        return false;
+    }
+    g_arena.handles.push_back(h1);
+    g_arena.handles.push_back(h2);
+    s.bounds.add(h1);
+    s.bounds.add(h2);
+    const int piece = s.npieces() - 1;
+    if (piece % CHUNK_PIECES == 0) {
+        // its chunk is made by index_appended_piece below.
+        EpochChunk e;
+        e.created = epoch;
+        e.erased = EPOCH_NEVER;
+        g_arena.epochs.push_back(e);
+    } else {
+        s.set_epochs(piece, epoch, EPOCH_NEVER);
+    }
+    add_to_spatial_hash(SegPointGuid(seg_guid, piece));
+    index_appended_piece(seg_guid);
+    assert(g_arena.first_chunk + g_arena.epochs.size() == g_chunks.size());
+    return true;
+}
+
+// append `p` to segment `seg_guid` with a straight piece. returns whether
+// this made a piece, which shows from command `epoch` on.
+bool append_point(int seg_guid, V2<int> p, int epoch) {
+    JournalRecord rec;
+    rec.type = JOURNAL_POINT;
+    rec.seg = seg_guid;
+    rec.a = p.x;
+    rec.b = p.y;
+    rec.c = 0;
+    g_journal.append(rec);
+    const Segment &s = g_segments[seg_guid];
+    const V2<int> prev = s.npoints > 0 ? s.point(s.npoints - 1) : p;
+    return push_point(seg_guid, p, prev, p, epoch);
+}
+
+// the stroke `seg_guid` being drawn is finished: replace its pieces by
+// cubics fit to its points, and pack it. The pieces all belong to the
+// current command if `in_command`, and to no command otherwise (replay).
+// Fitting is deterministic, so replaying the journal fits the same way.
+void fit_segment(int seg_guid, bool in_command) {
+    Segment &s = g_segments[seg_guid];
+    assert(s.storage == SEGMENT_RAW && seg_guid + 1 == g_segments.size());
+    JournalRecord rec;
+    rec.type = JOURNAL_FIT;
+    rec.seg = seg_guid;
+    rec.a = rec.b = rec.c = 0;
+    g_journal.append(rec);
+
+    static vector<V2<int>> pts, handles;
+    static vector<int> knots;
+    pts.assign(g_arena.points.begin() + s.first_point, g_arena.points.end());
+    knots.clear();
+    handles.clear();
+    fit_cubics(pts.data(), pts.size(), knots, handles);
+    if (knots.size() + 1 >= pts.size()) {
+        pack_segment(s);
+        return;
+    }
+
+    // the stroke cannot be undone or erased while it is drawn, so all its
+    // pieces share one epoch.
+    const int epoch = s.created(0);
+    for (int i = 0; i < s.npieces(); ++i) {
+        assert(s.created(i) == epoch && s.erased(i) == EPOCH_NEVER);
+        remove_from_spatial_hash(SegPointGuid(seg_guid, i));
+    }
+    // its chunks are the last ones.
+    for (int k = s.first_chunk; k < g_chunks.size(); ++k) {
+        g_ink_index.remove(k);
+    }
+    g_chunks.resize(s.first_chunk);
+    g_arena.epochs.resize(s.first_chunk - g_arena.first_chunk);
+    invalidate_ink(s.bounds);
+    if (in_command) {
+        Command &c = g_commander.cmd(g_commander.runtill);
+        assert(c.size() == 1 && c[0].seg_guid == seg_guid &&
+               c[0].begin == 0 && c[0].end == s.npieces());
+        c[0].end = knots.size();
+    }
+    g_arena.points.resize(s.first_point);
+    g_arena.handles.resize(2 * s.first_piece);
+    s.npoints = 0;
+    s.first_chunk = -1;
+    s.bounds = Box();
+
+    push_point(seg_guid, pts[0], pts[0], pts[0], epoch);
+    for (int i = 0; i < knots.size(); ++i) {
+        push_point(seg_guid, pts[knots[i]], handles[2 * i], handles[2 * i + 1],
+                   epoch);
+    }
+    pack_segment(s);
+}
+
+void discard_command(int epoch, const Command &c) {
+    for (const PieceRange &r : c) {
+        assert(r.seg_guid < g_segments.size());
+        Segment &s = g_segments[r.seg_guid];
+        assert(0 <= r.begin && r.begin < r.end && r.end <= s.npieces());
+        for (int i = r.begin; i < r.end; ++i) {
+            if (s.created(i) == epoch) {
+                // the stroke can never come back: stop indexing it.
+                remove_from_spatial_hash(SegPointGuid(r.seg_guid, i));
+                s.set_epochs(i, EPOCH_NEVER, s.erased(i));
+            } else {
+                assert(s.erased(i) == epoch);
+                s.set_epochs(i, s.created(i), EPOCH_NEVER);
+            }
+        }
+        mark_chunks_dirty(r.seg_guid, r.begin, r.end);
+    }
+    flush_dirty_chunks();
+}
+
+// memory save_board works in. The compaction child must not allocate: it
+// is forked from a threaded process, where another thread may hold the
+// allocator's lock. compact_board sizes all of it before forking.
+struct SaveScratch {
+    vector<bool> keep;
+    vector<pair<Cell, int>> by_region;
+    vector<int> created, erased;
+    vector<V2<int>> points, handles, chunk_points, chunk_handles;
+    BoardWriter writer;
+};
+
+void reserve_save(SaveScratch &sc) {
+    int max_points = 0;
+    for (const Segment &s : g_segments) {
+        max_points = max(max_points, s.npoints);
+    }
+    sc.keep.reserve(g_segments.size());
+    sc.by_region.reserve(g_segments.size());
+    sc.created.reserve(max_points);
+    sc.erased.reserve(max_points);
+    sc.points.reserve(max_points);
+    sc.handles.reserve(2 * max_points);
+    sc.chunk_points.reserve(CHUNK_PIECES + 1);
+    sc.chunk_handles.reserve(2 * CHUNK_PIECES);
+    // the snapshot indexes some of the pieces indexed now, in cells of the
+    // same size.
+    sc.writer.reserve(g_spatial_hash.size() +
+                      (g_board.header ? g_board.header->nentries : 0));
+}
+
+// write the board as it looks now to `path`, to be followed by journal
+// `journal_generation`. Allocates nothing beyond what reserve_save made
+// room for.
+bool save_board(const char *path, uint32_t journal_generation,
+                SaveScratch &sc) {
+    // a segment is kept whole, even if only one piece is left, so that
+    // guids and piece indices stay what the journal refers to.
+    vector<bool> &keep = sc.keep;
+    keep.assign(g_segments.size(), false);
+    uint64_t npoints = 0, nchunks = 0;
+    for (int i = 0; i < g_segments.size(); ++i) {
+        const Segment &s = g_segments[i];
+        for (int j = 0; j < s.npieces(); ++j) {
+            if (s.created(j) != EPOCH_NEVER) {
+                keep[i] = true;
+                break;
+            }
+        }
+        // a segment still being drawn has no piece yet.
+        keep[i] = keep[i] || s.npieces() == 0;
+        if (keep[i]) {
+            npoints += s.npoints;
+            nchunks += s.nchunks();
+        }
+    }
+
+    // lay segments out region by region, keyed by their middle.
+    vector<pair<Cell, int>> &by_region = sc.by_region;
+    by_region.clear();
     for (int i = 0; i < g_segments.size(); ++i) {
         const Segment &s = g_segments[i];
-        if (s.points.size() < 2) {
+        Cell c;
+        if (keep[i] && s.npoints > 0) {
+            // a long stroke goes where most of it is.
+            const V2<int> mid((s.bounds.lo.x / 2 + s.bounds.hi.x / 2),
+                              (s.bounds.lo.y / 2 + s.bounds.hi.y / 2));
+            c.cx = floor_div(mid.x, BOARD_REGION_SZ);
+            c.cy = floor_div(mid.y, BOARD_REGION_SZ);
+        }
+        by_region.push_back(make_pair(c, i));
+    }
+    sort(by_region.begin(), by_region.end());
+    uint64_t nregions = 0;
+    for (int k = 0; k < by_region.size(); ++k) {
+        nregions += k == 0 || !(by_region[k].first == by_region[k - 1].first);
+    }
+
+    BoardWriter &w = sc.writer;
+    if (!w.begin(path, g_segments.size(), nregions, npoints, nchunks,
+                 CHUNK_PIECES, HASH_CELL_SZ, journal_generation)) {
+        return false;
+    }
+    vector<int> &created = sc.created, &erased = sc.erased;
+    for (int k = 0; k < by_region.size(); ++k) {
+        if (k > 0 && !(by_region[k].first == by_region[k - 1].first)) {
+            w.end_region();
+        }
+        const int i = by_region[k].second;
+        const Segment &s = g_segments[i];
+        if (!keep[i]) {
+            w.add_segment(i, s.color(), nullptr, nullptr, nullptr, nullptr,
+                          0);
+            continue;
+        }
+        const V2<int> *pts = s.points_in(0, s.npoints, sc.points);
+        created.clear();
+        erased.clear();
+        for (int j = 0; j < s.npieces(); ++j) {
+            if (s.created(j) == EPOCH_NEVER) {
+                created.push_back(EPOCH_NEVER);
+                erased.push_back(EPOCH_NEVER);
+                continue;
+            }
+            const bool visible = piece_visible(s, j);
+            created.push_back(-1);
+            erased.push_back(visible ? EPOCH_NEVER : -1);
+            w.index_piece(SegPointGuid(i, j), pts[j], pts[j + 1]);
+        }
+        w.add_segment(i, s.color(), pts, created.data(), erased.data(),
+                      s.handles_in(0, s.npieces(), sc.handles), s.npoints);
+    }
+    if (!by_region.empty()) {
+        w.end_region();
+    }
+    // chunk ids are paint order, keep it.
+    for (const Chunk &c : g_chunks) {
+        if (!keep[c.seg_guid]) {
+            continue;
+        }
+        Box bounds, ink;
+        compute_chunk_boxes(c, bounds, ink, sc.chunk_points,
+                            sc.chunk_handles);
+        w.add_chunk(c.seg_guid, c.begin, bounds, ink);
+    }
+    return w.finish();
+}
+
+bool save_board(const char *path, uint32_t journal_generation) {
+    SaveScratch sc;
+    reserve_save(sc);
+    return save_board(path, journal_generation, sc);
+}
+
+// open the board at `path` as the starting state. Segments point into the
+// mapping, and chunk boxes come from the file, so no point is read here.
+bool load_board(const char *path) {
+    assert(g_segments.empty() && g_chunks.empty());
+    if (!g_board.open(path)) {
+        return false;
+    }
+    const BoardHeader &h = *g_board.header;
+    if (h.chunk_pieces != CHUNK_PIECES) {
+        cerr << "board: " << path << " has chunks of " << h.chunk_pieces
+             << " pieces, expected " << CHUNK_PIECES << "\n";
+        g_board.close();
+        return false;
+    }
+    // compaction sizes the next board's index by this one's.
+    if (h.cell_sz != HASH_CELL_SZ) {
+        cerr << "board: " << path << " has cells of " << h.cell_sz
+             << ", expected " << HASH_CELL_SZ << "\n";
+        g_board.close();
+        return false;
+    }
+
+    // the board checked every index while opening.
+    g_segments.resize(h.nsegments);
+    for (int i = 0; i < h.nsegments; ++i) {
+        const BoardSegment &b = g_board.segments[i];
+        Segment &s = g_segments[i];
+        s.storage = SEGMENT_MAPPED;
+        s.first_point = s.first_piece = b.first_point;
+        s.npoints = b.npoints;
+        s.colorix = palette_index(b.r, b.g, b.b);
+    }
+    for (int i = 0; i < h.nchunks; ++i) {
+        const BoardChunk &b = g_board.chunks[i];
+        Chunk c;
+        c.seg_guid = b.seg_guid;
+        c.begin = b.begin;
+        Segment &s = g_segments[c.seg_guid];
+        if (c.begin == 0) {
+            s.first_chunk = g_chunks.size();
+        }
+        assert(s.first_chunk + c.begin / CHUNK_PIECES == g_chunks.size());
+        s.bounds.add(box_from_board(b.bounds));
+        invalidate_ink(box_from_board(b.bounds));
+        g_ink_index.insert(g_chunks.size(), box_from_board(b.bounds),
+                           box_from_board(b.ink));
+        g_chunks.push_back(c);
+    }
+    g_arena.first_chunk = g_chunks.size();
+    cerr << "board: loaded " << h.nsegments << " segments, " << h.npoints
+         << " points from " << path << "\n";
+    return true;
+}
+
+// a replayed segment can be fit: it is the raw last one, and its pieces
+// are as drawn, shown from the start.
+static bool fittable(int seg_guid) {
+    const Segment &s = g_segments[seg_guid];
+    if (seg_guid + 1 != g_segments.size() || s.storage != SEGMENT_RAW) {
+        return false;
+    }
+    for (int i = 0; i < s.npieces(); ++i) {
+        if (s.created(i) != -1 || s.erased(i) != EPOCH_NEVER) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// apply journaled changes on top of the loaded board. Replayed pieces
+// belong to no command: they show from the start, like loaded ones.
+// false at the first record that does not fit the board. Records out of
+// drawing order are skipped: a segment only grows while it is the raw
+// last one, and is fit before any of it is erased.
+bool replay_journal(const vector<JournalRecord> &records) {
+    for (int k = 0; k < records.size(); ++k) {
+        const JournalRecord &r = records[k];
+        if (r.type == JOURNAL_SEGMENT) {
+            if (r.seg != g_segments.size()) {
+                return false;
+            }
+            new_segment(palette_index(r.a, r.b, r.c));
+            continue;
+        }
+        if (r.seg < 0 || r.seg >= g_segments.size()) {
+            return false;
+        }
+        Segment &s = g_segments[r.seg];
+        const char *skip = nullptr;
+        if (r.type == JOURNAL_POINT) {
+            // loaded segments are mapped, and never grow.
+            if (r.seg + 1 != g_segments.size() || s.storage != SEGMENT_RAW) {
+                skip = "point on a finished segment";
+            }
+        } else if (r.type == JOURNAL_FIT) {
+            if (!fittable(r.seg)) {
+                skip = "fit of a finished or erased segment";
+            }
+        } else if (r.type != JOURNAL_VISIBILITY) {
+            skip = "unknown type";
+        }
+        if (skip) {
+            cerr << "journal: skipping record " << k << " (type " << r.type
+                 << ", segment " << r.seg << "): " << skip << "\n";
+            continue;
+        }
+        if (r.type == JOURNAL_POINT) {
+            append_point(r.seg, V2<int>(r.a, r.b), -1);
+            continue;
+        }
+        if (r.type == JOURNAL_FIT) {
+            fit_segment(r.seg, false);
+            continue;
+        }
+        if (r.a < 0 || r.a >= r.b || r.b > s.npieces()) {
+            return false;
+        }
+        for (int i = r.a; i < r.b; ++i) {
+            if (s.created(i) != EPOCH_NEVER) {
+                s.set_epochs(i, -1, r.c ? EPOCH_NEVER : -1);
+            }
+        }
+        mark_chunks_dirty(r.seg, r.a, r.b);
+    }
+    flush_dirty_chunks();
+    return true;
+}
+
+// load the board at g_board_path if there is one, replay the journals
+// written since its snapshot, and keep journaling after the last one.
+bool open_board() {
+    uint32_t gen = 0;
+    if (access(g_board_path, F_OK) == 0) {
+        if (!load_board(g_board_path)) {
+            return false;
+        }
+        gen = g_board.header->journal_generation;
+    }
+    g_snapshot_generation = gen;
+    // journals older than the snapshot are already in it.
+    if (gen > 0) {
+        unlink(journal_path(g_board_path, gen - 1).c_str());
+    }
+
+    // the last journal is appended to. a compaction that did not finish
+    // leaves one more journal behind.
+    uint32_t last = gen;
+    long valid_bytes = 0;
+    vector<JournalRecord> records;
+    for (uint32_t g = gen;; ++g) {
+        long valid;
+        if (!read_journal(journal_path(g_board_path, g), g, records, valid)) {
+            break;
+        }
+        if (!replay_journal(records)) {
+            cerr << "journal: " << journal_path(g_board_path, g)
+                 << " does not match the board\n";
+            return false;
+        }
+        cerr << "journal: replayed " << records.size() << " records from "
+             << journal_path(g_board_path, g) << "\n";
+        last = g;
+        valid_bytes = valid;
+    }
+    // the last replayed stroke is finished too.
+    if (!g_segments.empty()) {
+        pack_segment(g_segments.back());
+    }
+    return g_journal.open(journal_path(g_board_path, last), last,
+                          valid_bytes);
+}
+
+// write a new snapshot in the background, so that the journal can start
+// over. The snapshot is written by a forked child, which sees the board
+// frozen at the fork and writes it while we keep drawing.
+void compact_board() {
+    // a segment being drawn must not end up mapped: it would stop growing.
+    if (g_compaction_pid != -1 || g_curvestate.is_down ||
+        !g_journal.is_open()) {
+        return;
+    }
+    // changes from now on go to the next journal, which is replayed on
+    // top of the new snapshot.
+    if (!g_journal.rotate(
+            journal_path(g_board_path, g_journal.generation() + 1))) {
+        return;
+    }
+    const uint32_t gen = g_journal.generation();
+    // everything the child needs is allocated here: it only makes system
+    // calls.
+    SaveScratch scratch;
+    reserve_save(scratch);
+    vector<string> old_journals;
+    for (uint32_t g = g_snapshot_generation; g < gen; ++g) {
+        old_journals.push_back(journal_path(g_board_path, g));
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+        // the child only touches the board in memory and its own files.
+        const bool ok = save_board(g_board_path, gen, scratch);
+        for (int i = 0; ok && i < old_journals.size(); ++i) {
+            unlink(old_journals[i].c_str());
+        }
+        _exit(ok ? 0 : 1);
+    }
+    if (pid == -1) {
+        // both journals are replayed on the old snapshot, nothing is lost.
+        cerr << "journal: unable to fork for compaction\n";
+        return;
+    }
+    g_compaction_pid = pid;
+    g_compaction_generation = gen;
+    cerr << "journal: compacting into " << g_board_path << "\n";
+}
+
+void reap_compaction() {
+    if (g_compaction_pid == -1) {
+        return;
+    }
+    int status;
+    if (waitpid(g_compaction_pid, &status, WNOHANG) != g_compaction_pid) {
+        return;
+    }
+    g_compaction_pid = -1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        cerr << "journal: compaction failed, keeping the journals\n";
+        return;
+    }
+    g_snapshot_generation = g_compaction_generation;
+}
+
+// draw the visible pieces among points [begin, end) of `s`, one polyline
+// per run.
+void draw_pieces(const Segment &s, int begin, int end, int line_radius) {
+    assert(0 <= begin && begin <= end && end <= s.npoints);
+    static vector<V2<int>> scratch, handle_scratch;
+    // pts[i] is point begin + i, hs[2 * i] its first handle.
+    const V2<int> *pts = s.points_in(begin, end, scratch);
+    const V2<int> *hs =
+        end - begin > 1 ? s.handles_in(begin, end - 1, handle_scratch)
+                        : nullptr;
+    int l = begin;
+    while (l + 1 < end) {
+        if (!piece_visible(s, l)) {
+            l++;
             continue;
         }
-        const int line_radius = g_renderstate.zoom * PEN_RADIUS;
-        // TODO: incorporate erasing here.
-        vg_draw_lines(s.points, s.visible, line_radius, s.color,
-                      g_renderstate.pan, g_renderstate.zoom);
+        // r: first piece not to draw.
+        int r = l;
+        while (r + 1 < end && piece_visible(s, r)) {
+            r++;
+        }
+        vg_draw_curves(pts + (l - begin), hs + 2 * (l - begin), r - l + 1,
+                       line_radius, s.color(), g_renderstate.pan,
+                       g_renderstate.zoom);
+        l = r;
     }
 }
 
+// segments of the loaded board are drawn once their region is in memory.
+bool segment_resident(int seg_guid) {
+    if (!g_streamer.started() || seg_guid >= g_board.header->nsegments) {
+        return true;
+    }
+    return g_streamer.resident(g_board.segments[seg_guid].region);
+}
+
+// world space rectangle shown by the screen rect at (x, y) of w x h, grown
+// by the pen so that strokes just outside still get their edges drawn.
+Box world_rect(int x, int y, int w, int h) {
+    const V2<int> lo =
+        (V2<float>(x, y) / g_renderstate.zoom).cast<int>() + g_renderstate.pan;
+    const V2<int> hi =
+        (V2<float>(x + w, y + h) / g_renderstate.zoom).cast<int>() +
+        g_renderstate.pan;
+    return Box(lo - V2<int>(PEN_RADIUS, PEN_RADIUS),
+               hi + V2<int>(PEN_RADIUS, PEN_RADIUS));
+}
+
+// draw the strokes in world box `viewport`.
+void draw_pen_strokes_cr(const Box &viewport) {
+    static vector<int> visible_chunks;
+    visible_chunks.clear();
+    g_ink_index.query(viewport,
+                      [](int chunk_id) { visible_chunks.push_back(chunk_id); });
+    sort(visible_chunks.begin(), visible_chunks.end());
+
+    const int line_radius = g_renderstate.zoom * PEN_RADIUS;
+    for (int i = 0; i < visible_chunks.size();) {
+        // merge runs of consecutive chunks of a segment into one call.
+        const Chunk &first = g_chunks[visible_chunks[i]];
+        int j = i + 1;
+        while (j < visible_chunks.size() &&
+               visible_chunks[j] == visible_chunks[j - 1] + 1 &&
+               g_chunks[visible_chunks[j]].seg_guid == first.seg_guid) {
+            j++;
+        }
+        if (!segment_resident(first.seg_guid)) {
+            i = j;
+            continue;
+        }
+        const Segment &s = g_segments[first.seg_guid];
+        const int begin = first.begin;
+        const int end = min<int>(g_chunks[visible_chunks[j - 1]].begin +
+                                     CHUNK_PIECES + 1,
+                                 s.npoints);
+        draw_pieces(s, begin, end, line_radius);
+        i = j;
+    }
+}
+
+// draw the visible pieces in world box `box` into the overview pyramid.
+// false if some of them are not streamed in yet.
+bool draw_overview_tile(const Box &box) {
+    static vector<int> chunks;
+    chunks.clear();
+    // ink reaches PEN_HALF_WIDTH past the points in the index, as in
+    // invalidate_ink.
+    const Box query(box.lo - V2<int>(PEN_HALF_WIDTH, PEN_HALF_WIDTH),
+                    box.hi + V2<int>(PEN_HALF_WIDTH, PEN_HALF_WIDTH));
+    g_ink_index.query(query,
+                      [](int chunk_id) { chunks.push_back(chunk_id); });
+    sort(chunks.begin(), chunks.end());
+    bool complete = true;
+    static vector<V2<int>> scratch;
+    for (int chunk_id : chunks) {
+        const Chunk &c = g_chunks[chunk_id];
+        if (!segment_resident(c.seg_guid)) {
+            complete = false;
+            continue;
+        }
+        const Segment &s = g_segments[c.seg_guid];
+        const int end = min<int>(c.begin + CHUNK_PIECES, s.npieces());
+        const V2<int> *pts = s.points_in(c.begin, end + 1, scratch);
+        // a piece never strays farther than FIT_CHORD_TOL from its chord,
+        // well within a texel.
+        for (int i = c.begin; i < end; ++i) {
+            if (piece_visible(s, i)) {
+                g_overview_pyramid.line(pts[i - c.begin],
+                                        pts[i - c.begin + 1], PEN_RADIUS,
+                                        s.color());
+            }
+        }
+    }
+    return complete;
+}
+
+// the overview is drawn from the pyramid, never stroke by stroke.
+void draw_overview() {
+    const V2<int> screen_dim =
+        (V2<float>(SCREEN_WIDTH, SCREEN_HEIGHT) / g_renderstate.zoom)
+            .cast<int>();
+    const Box viewport(g_renderstate.pan, g_renderstate.pan + screen_dim);
+    if (g_streamer.started()) {
+        g_streamer.want(viewport);
+    }
+    g_overview_pyramid.update(OVERVIEW_TILES_PER_OVERVIEW_FRAME,
+                              draw_overview_tile);
+    g_overview_pyramid.draw(viewport, g_renderstate.pan, g_renderstate.zoom);
+}
+
+// the rest of the stroke being drawn, from its last settled point,
+// through the samples the filter still holds back, to where the pen is
+// predicted to be by the time this frame is on screen. Rebuilt every
+// frame, so the prediction gives way to the real samples as they come in.
+const vector<V2<int>> &pen_tail() {
+    static vector<V2<int>> tail;
+    tail.clear();
+    if (!g_curvestate.is_down || g_colorstate.is_eraser) {
+        return tail;
+    }
+    const Segment &s = g_segments[g_curvestate.seg_guid];
+    if (s.npoints > 0) {
+        tail.push_back(s.point(s.npoints - 1));
+    }
+    g_curvestate.filter.held_back(tail);
+    V2<int> predicted;
+    const uint32_t now = SDL_GetTicks() + g_curvestate.clock_offset;
+    if (g_curvestate.predictor.predict(now, 1000.0 / TARGET_FPS,
+                                       predicted)) {
+        tail.push_back(predicted);
+    }
+    return tail;
+}
+
+void draw_pen_tail() {
+    const vector<V2<int>> &tail = pen_tail();
+    if (tail.size() < 2) {
+        return;
+    }
+    static vector<V2<int>> handles;
+    handles.clear();
+    for (int i = 0; i + 1 < tail.size(); ++i) {
+        handles.push_back(tail[i]);
+        handles.push_back(tail[i + 1]);
+    }
+    vg_draw_curves(tail.data(), handles.data(), tail.size(),
+                   g_renderstate.zoom * PEN_RADIUS,
+                   g_segments[g_curvestate.seg_guid].color(),
+                   g_renderstate.pan, g_renderstate.zoom);
+}
+
 void draw_eraser_cr() {
     if (!g_colorstate.is_eraser) {
         return;
@@ -302,6 +1454,218 @@ void draw_grid_cr() {
     }
 };
 
+// background, grid and strokes, within the screen rect at (x, y) of w x h.
+void draw_board_rect(int x, int y, int w, int h) {
+    vg_draw_rect(x, y, w, h, Color::RGB(240, 240, 240));
+    draw_grid_cr();
+    draw_pen_strokes_cr(world_rect(x, y, w, h));
+}
+
+// draw the whole board in the window `n` times, as if nothing were kept
+// between frames, and report the time per frame, for comparing how vg
+// draws. bench/antialias.sh runs it in each mode on the same board.
+void bench_frames(int n) {
+    // let what the viewport shows stream in first: until nothing has loaded
+    // for a while.
+    if (g_streamer.started()) {
+        g_streamer.want(world_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
+        long loads = -1;
+        for (int quiet = 0; quiet < 10; ++quiet) {
+            if (g_streamer.loads() != loads) {
+                loads = g_streamer.loads();
+                quiet = 0;
+            }
+            SDL_Delay(50);
+        }
+    }
+    // the first frame compiles shaders and fills caches.
+    double total_ms = 0, worst_ms = 0;
+    long calls = 0, saved = 0;
+    for (int i = -1; i < n; ++i) {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        vg_begin_frame(SCREEN_WIDTH, SCREEN_HEIGHT);
+        draw_board_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        vg_end_frame();
+        // wait for the GPU, not just for the commands to be queued.
+        glFinish();
+        const double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                          SDL_GetPerformanceFrequency();
+        int c, s;
+        vg_render_stats(c, s);
+        if (i < 0) {
+            continue;
+        }
+        total_ms += ms;
+        worst_ms = max(worst_ms, ms);
+        calls += c;
+        saved += s;
+    }
+    // msaa 0 is nanovg's antialiasing.
+    printf("bench: %d frames of %dx%d, msaa %d: %.3f ms/frame, worst %.3f "
+           "ms, %ld gl calls/frame, %ld saved\n",
+           n, SCREEN_WIDTH, SCREEN_HEIGHT, g_msaa_samples, total_ms / n,
+           worst_ms, calls / n, saved / n);
+}
+
+// the whole window, in screen coordinates.
+Box screen_box() {
+    return Box(V2<int>(0, 0), V2<int>(SCREEN_WIDTH - 1, SCREEN_HEIGHT - 1));
+}
+
+// the part of the window within world box `b`, with a pixel or two to
+// spare for antialiasing.
+Box screen_box_of(const Box &b) {
+    if (b.empty()) {
+        return b;
+    }
+    const float z = g_renderstate.zoom;
+    const V2<int> pan = g_renderstate.pan;
+    Box r(V2<int>(floor(z * (b.lo.x - pan.x)) - 2,
+                  floor(z * (b.lo.y - pan.y)) - 2),
+          V2<int>(ceil(z * (b.hi.x - pan.x)) + 2,
+                  ceil(z * (b.hi.y - pan.y)) + 2));
+    r.lo.x = max(r.lo.x, 0);
+    r.lo.y = max(r.lo.y, 0);
+    r.hi.x = min(r.hi.x, SCREEN_WIDTH - 1);
+    r.hi.y = min(r.hi.y, SCREEN_HEIGHT - 1);
+    return r.empty() ? Box() : r;
+}
+
+// draw the board into the layer, within screen box `r`.
+void draw_layer_rect(const Box &r) {
+    const int w = r.hi.x - r.lo.x + 1, h = r.hi.y - r.lo.y + 1;
+    vg_layer_begin(r.lo.x, r.lo.y, w, h);
+    draw_board_rect(r.lo.x, r.lo.y, w, h);
+    vg_layer_end();
+}
+
+// bring the layer up to date with the board, before the frame is drawn.
+void update_board_layer() {
+    // stream in a screen's worth around the viewport, ready for panning.
+    if (g_streamer.started()) {
+        const Box viewport = world_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        const V2<int> screen_dim = viewport.hi - viewport.lo;
+        g_streamer.want(
+            Box(viewport.lo - screen_dim, viewport.hi + screen_dim));
+    }
+    if (g_scrollstate.usable &&
+        !vg_layer_resize(SCREEN_WIDTH, SCREEN_HEIGHT)) {
+        cerr << "render: no framebuffer objects, drawing every frame in "
+                "full\n";
+        g_scrollstate.usable = false;
+    }
+    if (!g_scrollstate.usable) {
+        g_damagestate.frame.add(screen_box());
+        return;
+    }
+
+    // at zoom 1 a pan moves the board by whole pixels.
+    const V2<int> d = g_renderstate.pan - g_scrollstate.pan;
+    const long loads = g_streamer.started() ? g_streamer.loads() : 0;
+    const bool scrolls =
+        g_scrollstate.valid && g_scrollstate.w == SCREEN_WIDTH &&
+        g_scrollstate.h == SCREEN_HEIGHT && g_scrollstate.loads == loads &&
+        g_renderstate.zoom == 1 && g_scrollstate.zoom == 1 &&
+        abs(d.x) < SCREEN_WIDTH && abs(d.y) < SCREEN_HEIGHT;
+    if (!scrolls) {
+        draw_layer_rect(screen_box());
+        g_damagestate.frame.add(screen_box());
+    } else {
+        if (d.x != 0 || d.y != 0) {
+            vg_layer_scroll(d.x, d.y);
+            g_damagestate.frame.add(screen_box());
+        }
+        // the columns, then the rows, that scrolled into view.
+        if (d.x != 0) {
+            const int x = d.x > 0 ? SCREEN_WIDTH - d.x : 0;
+            draw_layer_rect(Box(V2<int>(x, 0),
+                                V2<int>(x + abs(d.x) - 1, SCREEN_HEIGHT - 1)));
+        }
+        if (d.y != 0) {
+            const int y = d.y > 0 ? SCREEN_HEIGHT - d.y : 0;
+            draw_layer_rect(Box(V2<int>(0, y),
+                                V2<int>(SCREEN_WIDTH - 1, y + abs(d.y) - 1)));
+        }
+        // then the ink that changed.
+        const Box ink = screen_box_of(g_scrollstate.damage);
+        if (!ink.empty()) {
+            draw_layer_rect(ink);
+            g_damagestate.frame.add(ink);
+        }
+    }
+    g_scrollstate.damage = Box();
+    g_scrollstate.valid = true;
+    g_scrollstate.pan = g_renderstate.pan;
+    g_scrollstate.zoom = g_renderstate.zoom;
+    g_scrollstate.w = SCREEN_WIDTH;
+    g_scrollstate.h = SCREEN_HEIGHT;
+    g_scrollstate.loads = loads;
+}
+
+// the overlays drawn over the layer changed where they were and where they
+// are now.
+void damage_overlays() {
+    Box tail;
+    for (V2<int> p : pen_tail()) {
+        tail.add(Box::around(p, PEN_RADIUS));
+    }
+    tail = screen_box_of(tail);
+    Box eraser;
+    if (g_colorstate.is_eraser) {
+        const V2<float> pos =
+            g_renderstate.zoom * (g_penstate).cast<float>();
+        eraser = Box::around(pos.cast<int>(),
+                             g_colorstate.eraser_radius * g_renderstate.zoom +
+                                 2);
+    }
+    // the palette looks the same as long as this does.
+    const int palette = g_panstate.panning || g_overviewstate.overviewing
+                            ? -1
+                        : g_colorstate.is_eraser ? g_palette.size()
+                                                 : g_colorstate.colorix;
+    Box &frame = g_damagestate.frame;
+    frame.add(g_damagestate.tail);
+    frame.add(tail);
+    frame.add(g_damagestate.eraser);
+    frame.add(eraser);
+    if (palette != g_damagestate.palette) {
+        frame.add(Box(V2<int>(0, SCREEN_HEIGHT - 2 * PALETTE_HEIGHT()),
+                      V2<int>(SCREEN_WIDTH - 1, SCREEN_HEIGHT - 1)));
+    }
+    g_damagestate.tail = tail;
+    g_damagestate.eraser = eraser;
+    g_damagestate.palette = palette;
+}
+
+// the screen box this frame draws, empty if the window is up to date. A
+// `full` frame draws everything, and so does the one after it.
+Box frame_clip(bool full) {
+    DamageState &d = g_damagestate;
+    if (d.redraw || full) {
+        d.frame.add(screen_box());
+    }
+    d.redraw = full;
+    if (d.frame.empty()) {
+        return Box();
+    }
+    // the back buffer missed the frames since it was drawn.
+    Box clip = d.frame;
+    const int age = vg_back_buffer_age();
+    if (age == 0 || age > DAMAGE_HISTORY + 1) {
+        clip = screen_box();
+    }
+    for (int i = 0; i + 1 < age && i < DAMAGE_HISTORY; ++i) {
+        clip.add(d.history[i]);
+    }
+    for (int i = DAMAGE_HISTORY - 1; i > 0; --i) {
+        d.history[i] = d.history[i - 1];
+    }
+    d.history[0] = d.frame;
+    d.frame = Box();
+    return clip;
+}
+
 void draw_palette() {
     // selected palette is drawn slightly higher.
     int SELECTED_PALETTE_HEIGHT = PALETTE_HEIGHT() * 1.3;
@@ -341,20 +1705,101 @@ double lerp(double t, int x0, int x1) {
     return x1 * t + x0 * (1 - t);
 }
 
-// handle easytab packet with index p
-void handle_packet(int p) {
-    assert(p >= 0);
-    assert(p < EasyTab->NumPackets);
+// erase everything under the eraser path gathered since the last flush.
+void flush_eraser() {
+    if (g_eraserstate.sweep.empty()) {
+        return;
+    }
+    // erased pieces stay in the spatial hash, so that undoing the erase
+    // makes them erasable again.
+    auto erase_piece = [](SegPointGuid v, V2<int> from, V2<int> to) {
+        Segment &s = g_segments[v.seg_guid];
+        assert(v.point_guid < s.npieces());
+        // erased before, or already hit through another cell of the
+        // piece.
+        if (!piece_visible(s, v.point_guid)) {
+            return;
+        }
+        g_eraserstate.erased.push_back(v);
+        s.set_epochs(v.point_guid, s.created(v.point_guid),
+                     g_commander.runtill);
+        mark_chunk_dirty(v);
+    };
+    g_spatial_hash.query_swept(g_eraserstate.sweep, erase_piece);
+    // pieces of the loaded board are indexed in the file.
+    g_board.index.query_swept(
+        g_eraserstate.sweep,
+        [](SegPointGuid v, V2<int> &from, V2<int> &to) {
+            const Segment &s = g_segments[v.seg_guid];
+            from = s.point(v.point_guid);
+            to = s.point(v.point_guid + 1);
+        },
+        erase_piece);
+    flush_dirty_chunks();
+    g_eraserstate.sweep.clear();
+
+    // hash order is arbitrary. sorted, the pieces compress into few ranges.
+    sort(g_eraserstate.erased.begin(), g_eraserstate.erased.end());
+    for (SegPointGuid v : g_eraserstate.erased) {
+        g_commander.add_to_command(v);
+    }
+    const vector<SegPointGuid> &erased = g_eraserstate.erased;
+    for (int i = 0; i < erased.size();) {
+        int j = i + 1;
+        while (j < erased.size() && erased[j].seg_guid == erased[i].seg_guid &&
+               erased[j].point_guid == erased[j - 1].point_guid + 1) {
+            j++;
+        }
+        journal_visibility(erased[i].seg_guid, erased[i].point_guid,
+                           erased[j - 1].point_guid + 1);
+        i = j;
+    }
+    g_eraserstate.erased.clear();
+}
+
+// add the points the stroke filter settled to the stroke being drawn.
+void append_filtered_points() {
+    for (V2<int> p : g_curvestate.filtered) {
+        if (append_point(g_curvestate.seg_guid, p, g_commander.runtill)) {
+            const Segment &s = g_segments[g_curvestate.seg_guid];
+            g_commander.add_to_command(
+                SegPointGuid(g_curvestate.seg_guid, s.npieces() - 1));
+        }
+    }
+    g_curvestate.filtered.clear();
+}
+
+// the tablet, when the server has XInput2. EasyTab otherwise.
+XI2Tablet g_tablet;
+
+// XInput2 event data only lives while SDL dispatches the event, so the
+// tablet looks at events as they are queued.
+int tablet_event_watch(void *, SDL_Event *event) {
+    if (event->type == SDL_SYSWMEVENT) {
+        g_tablet.handle(&event->syswm.msg->msg.x11.event);
+    }
+    return 0;
+}
 
-    g_penstate.x = EasyTab->PosX[p];
-    g_penstate.y = EasyTab->PosY[p];
-    const float pressure = EasyTab->Pressure[p];
+// handle a sample of the pen.
+void handle_packet(const PenSample &p) {
+
+    // the eraser path ends with anything but an erasing packet.
+    if (!(g_colorstate.is_eraser &&
+          (p.buttons & EasyTab_Buttons_Pen_Touch))) {
+        flush_eraser();
+        g_eraserstate.has_last = false;
+    }
+
+    g_penstate.x = p.x;
+    g_penstate.y = p.y;
+    const float pressure = p.pressure;
     static const float PAN_FACTOR = 8;
 
     // overview
     if (g_overviewstate.overviewing) {
         // if tapped, move to tap location
-        if (EasyTab->Buttons & EasyTab_Buttons_Pen_Touch) {
+        if (p.buttons & EasyTab_Buttons_Pen_Touch) {
             g_renderstate.pan = g_renderstate.pan +  1.0/g_renderstate.zoom * g_penstate;
             g_renderstate.pan = g_renderstate.pan -
                                 V2<int>(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
@@ -372,39 +1817,30 @@ void handle_packet(int p) {
 
     // went from down to hovering of pen.
     if (g_curvestate.is_down && !g_colorstate.is_eraser &&
-        !(EasyTab->Buttons & EasyTab_Buttons_Pen_Touch)) {
+        !(p.buttons & EasyTab_Buttons_Pen_Touch)) {
         g_curvestate.is_down = false;
+        g_curvestate.filter.finish(g_curvestate.filtered);
+        append_filtered_points();
+        fit_segment(g_curvestate.seg_guid, true);
         return;
     }
 
     // pressing down, not with eraser.
-    if ((EasyTab->Buttons & EasyTab_Buttons_Pen_Touch) &&
+    if ((p.buttons & EasyTab_Buttons_Pen_Touch) &&
         !g_colorstate.is_eraser) {
         if (!g_curvestate.is_down) {
             g_curvestate.is_down = true;
-            g_segments.push_back(Segment());
-            g_curvestate.seg_guid = g_segments.size() - 1;
-            g_segments[g_curvestate.seg_guid].color =
-                g_palette[g_colorstate.colorix];
+            g_curvestate.seg_guid = new_segment(g_colorstate.colorix);
+            g_curvestate.filter.begin();
+            g_curvestate.predictor.begin();
             g_commander.start_new_command();
-            return;
         }
 
         const V2<int> cur = g_renderstate.pan + g_penstate;
-        const Color color = g_palette[g_colorstate.colorix];
-        Segment &s = g_segments[g_curvestate.seg_guid];
-        g_overviewstate.minPos.x = min<int>(g_overviewstate.minPos.x, cur.x);
-        g_overviewstate.minPos.y = min<int>(g_overviewstate.minPos.y, cur.y);
-
-        g_overviewstate.maxPos.x = max<int>(g_overviewstate.maxPos.x, cur.x);
-        g_overviewstate.maxPos.y = max<int>(g_overviewstate.maxPos.y, cur.y);
-
-        s.points.push_back(cur);
-        s.visible.push_back(true);
-        const int point_guid = s.points.size() - 1;
-        SegPointGuid v(g_curvestate.seg_guid, point_guid);
-        add_to_spatial_hash(v);
-        g_commander.add_to_command(v);
+        g_curvestate.filter.add(cur, p.ms, g_curvestate.filtered);
+        g_curvestate.predictor.add(cur, pressure, p.ms);
+        g_curvestate.clock_offset = p.ms - SDL_GetTicks();
+        append_filtered_points();
         return;
     }
 
@@ -429,7 +1865,7 @@ void handle_packet(int p) {
 
     // is drawing eraser.
     if (g_colorstate.is_eraser &&
-        (EasyTab->Buttons & EasyTab_Buttons_Pen_Touch)) {
+        (p.buttons & EasyTab_Buttons_Pen_Touch)) {
         if (!g_curvestate.is_down) {
             g_curvestate.is_down = true;
             g_commander.start_new_command();
@@ -437,54 +1873,34 @@ void handle_packet(int p) {
 
         g_colorstate.eraser_radius =
             MIN_ERASER_RADIUS +
-            (EasyTab->Pressure[p] * (MAX_ERASER_RADIUS - MIN_ERASER_RADIUS));
-
-        const int startx =
-            g_renderstate.pan.x + g_penstate.x - g_colorstate.eraser_radius;
-        const int starty =
-            g_renderstate.pan.y + g_penstate.y - g_colorstate.eraser_radius;
-        const int endx = startx + 2 * g_colorstate.eraser_radius;
-        const int endy = starty + 2 * g_colorstate.eraser_radius;
-
-        for (int xix = startx / HASH_CELL_SZ - 1;
-             xix <= endx / HASH_CELL_SZ + 1; ++xix) {
-            for (int yix = starty / HASH_CELL_SZ - 1;
-                 yix <= endy / HASH_CELL_SZ + 1; ++yix) {
-                auto it = g_spatial_hash.find(make_pair(xix, yix));
-                if (it == g_spatial_hash.end()) {
-                    continue;
-                }
-                unordered_set<SegPointGuid, hash_spatial_hash_value> &bucket =
-                    it->second;
-                vector<SegPointGuid> to_erase;
-                for (SegPointGuid v : bucket) {
-                    Segment &s = g_segments[v.seg_guid];
-                    assert(v.point_guid < s.points.size());
-                    if (s.visible[v.point_guid] == false) {
-                        continue;
-                    }
-                    const V2<int> delta =
-                        g_renderstate.pan + g_penstate - s.points[v.point_guid];
-                    // eraser has some radius without pressing.
-                    // With pressing, becomes bigger.
-                    if (delta.lensq() <= g_colorstate.eraser_radius *
-                                             g_colorstate.eraser_radius) {
-                        to_erase.push_back(v);
-                        g_commander.add_to_command(v);
-                        s.visible[v.point_guid] = false;
-                    }
-                }
-                for (auto e : to_erase) {
-                    remove_from_spatial_hash(e);
-                }
-            }
+            (p.pressure * (MAX_ERASER_RADIUS - MIN_ERASER_RADIUS));
+
+        // eraser has some radius without pressing.
+        // With pressing, becomes bigger.
+        // a piece is a capsule of radius PEN_HALF_WIDTH, so it is hit when
+        // its centre line comes within eraser + pen of the eraser's path.
+        // the path since the previous packet is swept as one capsule, and
+        // all capsules of a frame are erased together in flush_eraser().
+        const V2<int> center = g_renderstate.pan + g_penstate;
+        const V2<int> from =
+            g_eraserstate.has_last ? g_eraserstate.last : center;
+        const int reach = g_colorstate.eraser_radius + PEN_HALF_WIDTH;
+        g_eraserstate.sweep.add(from, center, reach);
+        // flush_eraser reads the pieces under the sweep this frame: get
+        // regions that are out on their way in.
+        if (g_streamer.started()) {
+            Box box = Box::around(from, reach);
+            box.add(Box::around(center, reach));
+            g_streamer.prefetch(box);
         }
+        g_eraserstate.last = center;
+        g_eraserstate.has_last = true;
         return;
     }  // end if(is_eraser )
 
     // not erasing / hovering eraser
     if (g_colorstate.is_eraser &&
-        !(EasyTab->Buttons & EasyTab_Buttons_Pen_Touch)) {
+        !(p.buttons & EasyTab_Buttons_Pen_Touch)) {
         g_curvestate.is_down = false;
         return;
     }
@@ -496,13 +1912,17 @@ bool handle_event(SDL_SysWMinfo sysinfo, SDL_GLContext gl_context,
     if (event.type == SDL_QUIT) {
         return true;
     }
+    // resized, exposed or covered: draw it all again to be sure.
+    if (event.type == SDL_WINDOWEVENT) {
+        g_damagestate.redraw = true;
+    }
 
     if (event.type == SDL_WINDOWEVENT &&
         event.window.event == SDL_WINDOWEVENT_RESIZED) {
         SCREEN_WIDTH = event.window.data1;
         SCREEN_HEIGHT = event.window.data2;
         // vg_init(gl_context);
-    } else if (event.type == SDL_SYSWMEVENT) {
+    } else if (event.type == SDL_SYSWMEVENT && !g_tablet.is_open()) {
         EasyTabResult res =
             EasyTab_HandleEvent(&event.syswm.msg->msg.x11.event);
         if (res != EASYTAB_OK) {
@@ -513,8 +1933,15 @@ bool handle_event(SDL_SysWMinfo sysinfo, SDL_GLContext gl_context,
             std::cerr << "- NumPackets: " << EasyTab->NumPackets << "\n";
         }
 
+        // EasyTab has no timestamps: samples are timed as they arrive.
         for (int p = 0; p < EasyTab->NumPackets; ++p) {
-            handle_packet(p);
+            PenSample s;
+            s.x = EasyTab->PosX[p];
+            s.y = EasyTab->PosY[p];
+            s.pressure = EasyTab->Pressure[p];
+            s.buttons = EasyTab->Buttons;
+            s.ms = SDL_GetTicks();
+            handle_packet(s);
         }  // end loop over packets
     } else if (event.type == SDL_KEYDOWN) {
         cerr << "keydown: " << SDL_GetKeyName(event.key.keysym.sym) << "\n";
@@ -538,6 +1965,13 @@ bool handle_event(SDL_SysWMinfo sysinfo, SDL_GLContext gl_context,
         } else if (event.key.keysym.sym == SDLK_r) {
             g_colorstate.colorix =
                 (g_colorstate.colorix + 1) % g_palette.size();
+        } else if (event.key.keysym.sym == SDLK_s) {
+            if (g_curvestate.is_down) {
+                return false;
+            }
+            // everything is journaled already: saving only folds the
+            // journal into the board file.
+            compact_board();
         }
     } else if (event.type == SDL_MOUSEBUTTONDOWN) {
         string button_name = "unk";
@@ -549,18 +1983,23 @@ bool handle_event(SDL_SysWMinfo sysinfo, SDL_GLContext gl_context,
                 button_name = "right";
                 if (!g_overviewstate.overviewing) {
                     g_overviewstate.overviewing = true;
+                    g_overviewstate.saved_pan = g_renderstate.pan;
+                    // tight bounds of what is still visible, not of
+                    // everything ever drawn.
+                    const Box ink = g_ink_index.ink_bounds();
                     float zoomout = 2.0;
-                    zoomout = std::max<float>(2.0 + 
-                        (g_overviewstate.maxPos.x - g_overviewstate.minPos.x) /
-                            SCREEN_WIDTH,
-                        zoomout);
-                    zoomout = std::max<float>(
-                        2.0 + (g_overviewstate.maxPos.y - g_overviewstate.minPos.y) /
-                            SCREEN_HEIGHT,
-                        zoomout);
+                    if (!ink.empty()) {
+                        zoomout = std::max<float>(
+                            2.0 + (ink.hi.x - ink.lo.x) / SCREEN_WIDTH,
+                            zoomout);
+                        zoomout = std::max<float>(
+                            2.0 + (ink.hi.y - ink.lo.y) / SCREEN_HEIGHT,
+                            zoomout);
+                        g_renderstate.pan =
+                            ink.lo - V2<int>(SCREEN_WIDTH / 2.0,
+                                             SCREEN_HEIGHT / 2.0);
+                    }
                     g_renderstate.zoom = 1.0 / zoomout;
-                    g_overviewstate.saved_pan = g_renderstate.pan;
-                    g_renderstate.pan = g_overviewstate.minPos - V2<int>(SCREEN_WIDTH /2.0, SCREEN_HEIGHT/2.0);
                     break;
                 }
                 if (g_overviewstate.overviewing) {
@@ -617,7 +2056,55 @@ bool handle_event(SDL_SysWMinfo sysinfo, SDL_GLContext gl_context,
     return false;
 }
 
-int main() {
+// the budget in megabytes in environment variable `name`, in bytes, or
+// `fallback` if it is unset or not a whole number of at most MAX_BUDGET_MB.
+static const unsigned long long MAX_BUDGET_MB = 1 << 20;
+size_t budget_from_env(const char *name, size_t fallback) {
+    const char *s = getenv(name);
+    if (!s) {
+        return fallback;
+    }
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long mb = strtoull(s, &end, 10);
+    // strtoull takes "-1" as ULLONG_MAX: only accept plain digits.
+    if (!isdigit((unsigned char)s[0]) || *end != '\0' || errno != 0 ||
+        mb == 0 || mb > MAX_BUDGET_MB) {
+        cerr << name << ": ignoring \"" << s << "\", want 1 to "
+             << MAX_BUDGET_MB << " MB\n";
+        return fallback;
+    }
+    return (size_t)mb << 20;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        g_board_path = argv[1];
+    }
+    g_stream_budget_bytes =
+        budget_from_env("WARD_STREAM_BUDGET_MB", g_stream_budget_bytes);
+    if (!open_board()) {
+        cerr << "unable to open board " << g_board_path << "\n";
+        return -1;
+    }
+    if (g_board.header) {
+        g_streamer.start(g_board, g_stream_budget_bytes);
+    }
+
+    g_history_budget_bytes =
+        budget_from_env("WARD_HISTORY_BUDGET_MB", g_history_budget_bytes);
+    if (const char *depth = getenv("WARD_DEPTH_STROKES")) {
+        if (atoi(depth)) {
+            g_vg_flags |= VG_DEPTH_STROKES;
+        }
+    }
+    if (const char *samples = getenv("WARD_MSAA")) {
+        g_msaa_samples = atoi(samples);
+    }
+    if (const char *frames = getenv("WARD_BENCH_FRAMES")) {
+        g_bench_frames = atoi(frames);
+    }
+
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         cerr << "Failed to initialise SDL\n";
         return -1;
@@ -632,6 +2119,10 @@ int main() {
     assert(SCREEN_WIDTH >= 0 && "unable to detect screen width");
     assert(SCREEN_HEIGHT >= 0 && "unable to detect screen height");
 
+    if (g_vg_flags & VG_DEPTH_STROKES) {
+        SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+    }
+
     // Create a window
     SDL_Window *window = SDL_CreateWindow(
         "WARD", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH,
@@ -656,18 +2147,30 @@ int main() {
         return -1;
     }
 
-    vg_init(gl_context);
+    vg_init(gl_context, g_vg_flags, g_msaa_samples);
+    if (g_bench_frames > 0) {
+        bench_frames(g_bench_frames);
+        g_streamer.stop();
+        SDL_GL_DeleteContext(gl_context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 0;
+    }
 
     SDL_SysWMinfo sysinfo;
     SDL_VERSION(&sysinfo.version);
     int ok = SDL_GetWindowWMInfo(window, &sysinfo);
     assert(ok == SDL_TRUE && "unable to get SDL X11 information");
-    ok = EasyTab_Load(sysinfo.info.x11.display, sysinfo.info.x11.window);
-    if (ok != EASYTAB_OK) {
-        cerr << "easytab error code: |" << ok << "|\n";
+    if (g_tablet.open(sysinfo.info.x11.display, sysinfo.info.x11.window)) {
+        SDL_AddEventWatch(tablet_event_watch, nullptr);
+    } else {
+        ok = EasyTab_Load(sysinfo.info.x11.display, sysinfo.info.x11.window);
+        if (ok != EASYTAB_OK) {
+            cerr << "easytab error code: |" << ok << "|\n";
+        }
+        assert(ok == EASYTAB_OK &&
+               "PLEASE plug in your drawing tablet! [unable to load easytab]");
     }
-    assert(ok == EASYTAB_OK &&
-           "PLEASE plug in your drawing tablet! [unable to load easytab]");
 
     std::cerr << "\t-checkpoint: " << __LINE__ << "\n";
     bool g_quit = false;
@@ -678,36 +2181,59 @@ int main() {
         while (!g_quit && SDL_PollEvent(&event)) {
             g_quit = handle_event(sysinfo, gl_context, event);
         }
+        // every tablet sample that came in since the last frame.
+        static vector<PenSample> samples;
+        g_tablet.take(samples);
+        for (const PenSample &p : samples) {
+            handle_packet(p);
+        }
+        samples.clear();
+        // one index query for all eraser packets of this frame.
+        flush_eraser();
+        reap_compaction();
+        if (g_journal.size() > JOURNAL_COMPACT_BYTES) {
+            compact_board();
+        }
 
-        glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-        vg_begin_frame(SCREEN_WIDTH, SCREEN_HEIGHT);
-        vg_draw_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT,
-                     Color::RGB(240, 240, 240));
         if (!g_overviewstate.overviewing) {
-            draw_grid_cr();
+            update_board_layer();
+            damage_overlays();
+            // keep the pyramid close to the board between overviews.
+            g_overview_pyramid.update(OVERVIEW_TILES_PER_FRAME,
+                                      draw_overview_tile);
         }
-        draw_pen_strokes_cr();
-        draw_eraser_cr();
-        if (!g_panstate.panning && !g_overviewstate.overviewing) {
-            draw_palette();
+        const Box clip = frame_clip(g_overviewstate.overviewing ||
+                                    !g_scrollstate.usable);
+        if (!clip.empty()) {
+            glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+            vg_begin_frame(SCREEN_WIDTH, SCREEN_HEIGHT);
+            vg_clip(clip.lo.x, clip.lo.y, clip.hi.x - clip.lo.x + 1,
+                    clip.hi.y - clip.lo.y + 1);
+            if (g_overviewstate.overviewing) {
+                vg_draw_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                             Color::RGB(240, 240, 240));
+                draw_overview();
+            } else if (g_scrollstate.usable) {
+                vg_draw_layer();
+            } else {
+                draw_board_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+            }
+            draw_pen_tail();
+            draw_eraser_cr();
+            if (!g_panstate.panning && !g_overviewstate.overviewing) {
+                draw_palette();
+            }
+            vg_end_frame();
+            SDL_GL_SwapWindow(window);
         }
-        vg_end_frame();
-        SDL_GL_SwapWindow(window);
 
         const Uint64 end_count = SDL_GetPerformanceCounter();
         const int counts_per_second = SDL_GetPerformanceFrequency();
         const double elapsedSec =
             (end_count - start_count) / (double)counts_per_second;
         const double elapsedMS = elapsedSec * 1000.0;
-        int FPS = 1.0 / elapsedSec;
-        const int TARGET_FPS = 30;
         const double timeToNextFrameMs = 1000.0 / TARGET_FPS;
-        printf(
-            "elapsed time: %4.2f | sleeping for: %4.2f | time to "
-            "next frame: %4.2f\n",
-             elapsedMS,
-            timeToNextFrameMs - elapsedMS, timeToNextFrameMs);
-
+        // frame times and GL call counts are reported by WARD_BENCH_FRAMES.
         if (timeToNextFrameMs > elapsedMS) {
             // SDL_Delay(floor(1000.0/TARGET_FPS - elapsedMS));
             // std::cout << "fps: " << FPS << " | elapsed msec: " << elapsedMS
@@ -717,7 +2243,13 @@ int main() {
     }
 
     // Tidy up
-    EasyTab_Unload(sysinfo.info.x11.display);
+    g_journal.close();
+    g_streamer.stop();
+    if (g_tablet.is_open()) {
+        SDL_DelEventWatch(tablet_event_watch, nullptr);
+    } else {
+        EasyTab_Unload(sysinfo.info.x11.display);
+    }
     SDL_GL_DeleteContext(gl_context);
 
     // SDL_DestroyRenderer(renderer);
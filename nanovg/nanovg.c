@@ -834,6 +834,11 @@ void nvgUpdateImage(NVGcontext* ctx, int image, const unsigned char* data)
 	ctx->params.renderUpdateTexture(ctx->params.userPtr, image, 0,0, w,h, data);
 }
 
+void nvgUpdateImageRegion(NVGcontext* ctx, int image, int x, int y, int w, int h, const unsigned char* data)
+{
+	ctx->params.renderUpdateTexture(ctx->params.userPtr, image, x,y, w,h, data);
+}
+
 void nvgImageSize(NVGcontext* ctx, int image, int* w, int* h)
 {
 	ctx->params.renderGetTextureSize(ctx->params.userPtr, image, w, h);
@@ -1280,47 +1285,59 @@ static void nvg__vset(NVGvertex* vtx, float x, float y, float u, float v)
 	vtx->v = v;
 }
 
-static void nvg__tesselateBezier(NVGcontext* ctx,
-								 float x1, float y1, float x2, float y2,
-								 float x3, float y3, float x4, float y4,
-								 int level, int type)
+// Flattens the cubic in one pass with forward differencing. The number of
+// segments comes up front from the control polygon (Wang's formula): with
+// n segments, a cubic strays at most 3/4 * max|p[i] - 2p[i+1] + p[i+2]| / n^2
+// from its chords, so n is the smallest count that keeps that under tessTol.
+static void nvg__flattenBezier(NVGcontext* ctx,
+							   float x1, float y1, float x2, float y2,
+							   float x3, float y3, float x4, float y4,
+							   int type)
 {
-	float x12,y12,x23,y23,x34,y34,x123,y123,x234,y234,x1234,y1234;
-	float dx,dy,d2,d3;
-
-	if (level > 10) return;
-
-	x12 = (x1+x2)*0.5f;
-	y12 = (y1+y2)*0.5f;
-	x23 = (x2+x3)*0.5f;
-	y23 = (y2+y3)*0.5f;
-	x34 = (x3+x4)*0.5f;
-	y34 = (y3+y4)*0.5f;
-	x123 = (x12+x23)*0.5f;
-	y123 = (y12+y23)*0.5f;
-
-	dx = x4 - x1;
-	dy = y4 - y1;
-	d2 = nvg__absf(((x2 - x4) * dy - (y2 - y4) * dx));
-	d3 = nvg__absf(((x3 - x4) * dy - (y3 - y4) * dx));
-
-	if ((d2 + d3)*(d2 + d3) < ctx->tessTol * (dx*dx + dy*dy)) {
-		nvg__addPoint(ctx, x4, y4, type);
-		return;
-	}
-
-/*	if (nvg__absf(x1+x3-x2-x2) + nvg__absf(y1+y3-y2-y2) + nvg__absf(x2+x4-x3-x3) + nvg__absf(y2+y4-y3-y3) < ctx->tessTol) {
-		nvg__addPoint(ctx, x4, y4, type);
-		return;
-	}*/
-
-	x234 = (x23+x34)*0.5f;
-	y234 = (y23+y34)*0.5f;
-	x1234 = (x123+x234)*0.5f;
-	y1234 = (y123+y234)*0.5f;
+	float ddx1, ddy1, ddx2, ddy2, dd, h, h2, h3;
+	float ax, ay, bx, by, cx, cy;
+	float x, y, dx, dy, d2x, d2y, d3x, d3y;
+	int i, n;
 
-	nvg__tesselateBezier(ctx, x1,y1, x12,y12, x123,y123, x1234,y1234, level+1, 0);
-	nvg__tesselateBezier(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
+	ddx1 = x1 - 2*x2 + x3;
+	ddy1 = y1 - 2*y2 + y3;
+	ddx2 = x2 - 2*x3 + x4;
+	ddy2 = y2 - 2*y3 + y4;
+	dd = nvg__maxf(ddx1*ddx1 + ddy1*ddy1, ddx2*ddx2 + ddy2*ddy2);
+	n = (int)ceilf(nvg__sqrtf(0.75f * nvg__sqrtf(dd) / ctx->tessTol));
+	// as many segments as the recursive subdivision could make at most.
+	n = nvg__clampi(n, 1, 1024);
+
+	// the cubic as a*t^3 + b*t^2 + c*t + p1.
+	ax = -x1 + 3*x2 - 3*x3 + x4;
+	ay = -y1 + 3*y2 - 3*y3 + y4;
+	bx = 3*x1 - 6*x2 + 3*x3;
+	by = 3*y1 - 6*y2 + 3*y3;
+	cx = 3*(x2 - x1);
+	cy = 3*(y2 - y1);
+
+	h = 1.0f / n;
+	h2 = h*h;
+	h3 = h2*h;
+	x = x1;
+	y = y1;
+	dx = ax*h3 + bx*h2 + cx*h;
+	dy = ay*h3 + by*h2 + cy*h;
+	d2x = 6*ax*h3 + 2*bx*h2;
+	d2y = 6*ay*h3 + 2*by*h2;
+	d3x = 6*ax*h3;
+	d3y = 6*ay*h3;
+	for (i = 1; i < n; i++) {
+		x += dx;
+		y += dy;
+		dx += d2x;
+		dy += d2y;
+		d2x += d3x;
+		d2y += d3y;
+		nvg__addPoint(ctx, x, y, 0);
+	}
+	// the end point exactly, whatever rounding piled up.
+	nvg__addPoint(ctx, x4, y4, type);
 }
 
 static void nvg__flattenPaths(NVGcontext* ctx)
@@ -1363,7 +1380,7 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 				cp1 = &ctx->commands[i+1];
 				cp2 = &ctx->commands[i+3];
 				p = &ctx->commands[i+5];
-				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], 0, NVG_PT_CORNER);
+				nvg__flattenBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], NVG_PT_CORNER);
 			}
 			i += 7;
 			break;
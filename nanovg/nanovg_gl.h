@@ -32,6 +32,13 @@ enum NVGcreateFlags {
 	NVG_STENCIL_STROKES	= 1<<1,
 	// Flag indicating that additional debug checks are done.
 	NVG_DEBUG 			= 1<<2,
+	// Flag indicating that consecutive opaque strokes of a solid color are merged into one draw,
+	// with their colors in the vertices. They are drawn without the stencil, in order.
+	NVG_BATCH_STROKES	= 1<<3,
+	// Flag indicating that batched strokes are drawn against the depth buffer: their opaque cores
+	// front to back, so that a pixel is shaded once, then their fringes in order. Needs
+	// NVG_BATCH_STROKES, and a depth buffer in what is drawn to.
+	NVG_DEPTH_STROKES	= 1<<4,
 };
 
 #if defined NANOVG_GL2_IMPLEMENTATION
@@ -51,6 +58,13 @@ enum NVGcreateFlags {
 
 #define NANOVG_GL_USE_STATE_FILTER (1)
 
+// glMultiDrawArrays is core since GL 1.4, but not in GLES.
+#if defined NANOVG_GL2 || defined NANOVG_GL3
+#define NANOVG_GL_USE_MULTIDRAW (1)
+#else
+#define NANOVG_GL_USE_MULTIDRAW (0)
+#endif
+
 // Creates NanoVG contexts for different OpenGL (ES) versions.
 // Flags should be combination of the create flags above.
 
@@ -97,8 +111,13 @@ GLuint nvglImageHandleGLES3(NVGcontext* ctx, int image);
 // These are additional flags on top of NVGimageFlags.
 enum NVGimageFlagsGL {
 	NVG_IMAGE_NODELETE			= 1<<16,	// Do not delete GL texture handle.
+	NVG_IMAGE_FRAMEBUFFER_DEPTH	= 1<<17,	// nvgluCreateFramebuffer adds a depth buffer.
 };
 
+// Returns the GL calls made since the last call, draws, uniform uploads and state changes, and
+// how many more there would have been without merging draws and skipping redundant state.
+void nvglRenderStats(NVGcontext* ctx, int* glCalls, int* glCallsSaved);
+
 #ifdef __cplusplus
 }
 #endif
@@ -165,6 +184,7 @@ enum GLNVGcallType {
 	GLNVG_CONVEXFILL,
 	GLNVG_STROKE,
 	GLNVG_TRIANGLES,
+	GLNVG_BATCHSTROKE,
 };
 
 struct GLNVGcall {
@@ -253,6 +273,8 @@ struct GLNVGcontext {
 	int cpaths;
 	int npaths;
 	struct NVGvertex* verts;
+	unsigned int* colors;	// RGBA8 premultiplied, one per vertex.
+	float* depths;			// Clip space z, one per vertex, with NVG_DEPTH_STROKES.
 	int cverts;
 	int nverts;
 	unsigned char* uniforms;
@@ -268,6 +290,23 @@ struct GLNVGcontext {
 	GLuint stencilFuncMask;
 	GLNVGblend blendFunc;
 	#endif
+	// Uniforms last uploaded this flush, or -1.
+	int boundUniforms;
+#if !NANOVG_GL_USE_UNIFORMBUFFER
+	GLNVGfragUniforms boundFrag;
+#endif
+
+	// Ranges for glMultiDrawArrays.
+	GLint* drawFirsts;
+	GLsizei* drawCounts;
+	int cdraws;
+
+	// Paths a batch can have and still be drawn against the depth buffer, this flush.
+	int depthPaths;
+
+	// GL calls made and saved, for nvglRenderStats.
+	int nglCalls;
+	int nglCallsSaved;
 
 	int dummyTex;
 };
@@ -295,9 +334,13 @@ static void glnvg__bindTexture(GLNVGcontext* gl, GLuint tex)
 	if (gl->boundTexture != tex) {
 		gl->boundTexture = tex;
 		glBindTexture(GL_TEXTURE_2D, tex);
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
 	}
 #else
 	glBindTexture(GL_TEXTURE_2D, tex);
+	gl->nglCalls++;
 #endif
 }
 
@@ -307,9 +350,13 @@ static void glnvg__stencilMask(GLNVGcontext* gl, GLuint mask)
 	if (gl->stencilMask != mask) {
 		gl->stencilMask = mask;
 		glStencilMask(mask);
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
 	}
 #else
 	glStencilMask(mask);
+	gl->nglCalls++;
 #endif
 }
 
@@ -324,9 +371,13 @@ static void glnvg__stencilFunc(GLNVGcontext* gl, GLenum func, GLint ref, GLuint
 		gl->stencilFuncRef = ref;
 		gl->stencilFuncMask = mask;
 		glStencilFunc(func, ref, mask);
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
 	}
 #else
 	glStencilFunc(func, ref, mask);
+	gl->nglCalls++;
 #endif
 }
 static void glnvg__blendFuncSeparate(GLNVGcontext* gl, const GLNVGblend* blend)
@@ -339,9 +390,13 @@ static void glnvg__blendFuncSeparate(GLNVGcontext* gl, const GLNVGblend* blend)
 
 		gl->blendFunc = *blend;
 		glBlendFuncSeparate(blend->srcRGB, blend->dstRGB, blend->srcAlpha,blend->dstAlpha);
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
 	}
 #else
 	glBlendFuncSeparate(blend->srcRGB, blend->dstRGB, blend->srcAlpha,blend->dstAlpha);
+	gl->nglCalls++;
 #endif
 }
 
@@ -465,6 +520,8 @@ static int glnvg__createShader(GLNVGshader* shader, const char* name, const char
 
 	glBindAttribLocation(prog, 0, "vertex");
 	glBindAttribLocation(prog, 1, "tcoord");
+	glBindAttribLocation(prog, 2, "vcolor");
+	glBindAttribLocation(prog, 3, "vdepth");
 
 	glLinkProgram(prog);
 	glGetProgramiv(prog, GL_LINK_STATUS, &status);
@@ -537,19 +594,26 @@ static int glnvg__renderCreate(void* uptr)
 		"	uniform vec2 viewSize;\n"
 		"	in vec2 vertex;\n"
 		"	in vec2 tcoord;\n"
+		"	in vec4 vcolor;\n"
+		"	in float vdepth;\n"
 		"	out vec2 ftcoord;\n"
 		"	out vec2 fpos;\n"
+		"	out vec4 fcolor;\n"
 		"#else\n"
 		"	uniform vec2 viewSize;\n"
 		"	attribute vec2 vertex;\n"
 		"	attribute vec2 tcoord;\n"
+		"	attribute vec4 vcolor;\n"
+		"	attribute float vdepth;\n"
 		"	varying vec2 ftcoord;\n"
 		"	varying vec2 fpos;\n"
+		"	varying vec4 fcolor;\n"
 		"#endif\n"
 		"void main(void) {\n"
 		"	ftcoord = tcoord;\n"
 		"	fpos = vertex;\n"
-		"	gl_Position = vec4(2.0*vertex.x/viewSize.x - 1.0, 1.0 - 2.0*vertex.y/viewSize.y, 0, 1);\n"
+		"	fcolor = vcolor;\n"
+		"	gl_Position = vec4(2.0*vertex.x/viewSize.x - 1.0, 1.0 - 2.0*vertex.y/viewSize.y, vdepth, 1);\n"
 		"}\n";
 
 	static const char* fillFragShader =
@@ -583,12 +647,14 @@ static int glnvg__renderCreate(void* uptr)
 		"	uniform sampler2D tex;\n"
 		"	in vec2 ftcoord;\n"
 		"	in vec2 fpos;\n"
+		"	in vec4 fcolor;\n"
 		"	out vec4 outColor;\n"
 		"#else\n" // !NANOVG_GL3
 		"	uniform vec4 frag[UNIFORMARRAY_SIZE];\n"
 		"	uniform sampler2D tex;\n"
 		"	varying vec2 ftcoord;\n"
 		"	varying vec2 fpos;\n"
+		"	varying vec4 fcolor;\n"
 		"#endif\n"
 		"#ifndef USE_UNIFORMBUFFER\n"
 		"	#define scissorMat mat3(frag[0].xyz, frag[1].xyz, frag[2].xyz)\n"
@@ -670,6 +736,8 @@ static int glnvg__renderCreate(void* uptr)
 		"		color *= scissor;\n"
 		"		result = color * innerCol;\n"
 		"	}\n"
+		"	// Vertex color, white but for batched strokes.\n"
+		"	result *= fcolor;\n"
 		"#ifdef NANOVG_GL3\n"
 		"	outColor = result;\n"
 		"#else\n"
@@ -983,10 +1051,24 @@ static void glnvg__setUniforms(GLNVGcontext* gl, int uniformOffset, int image)
 {
 	GLNVGtexture* tex = NULL;
 #if NANOVG_GL_USE_UNIFORMBUFFER
-	glBindBufferRange(GL_UNIFORM_BUFFER, GLNVG_FRAG_BINDING, gl->fragBuf, uniformOffset, sizeof(GLNVGfragUniforms));
+	if (gl->boundUniforms != uniformOffset) {
+		gl->boundUniforms = uniformOffset;
+		glBindBufferRange(GL_UNIFORM_BUFFER, GLNVG_FRAG_BINDING, gl->fragBuf, uniformOffset, sizeof(GLNVGfragUniforms));
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
+	}
 #else
 	GLNVGfragUniforms* frag = nvg__fragUniformPtr(gl, uniformOffset);
-	glUniform4fv(gl->shader.loc[GLNVG_LOC_FRAG], NANOVG_GL_UNIFORMARRAY_SIZE, &(frag->uniformArray[0][0]));
+	// Calls often repeat the uniforms of the one before, which need not be uploaded again.
+	if (gl->boundUniforms == -1 || memcmp(&gl->boundFrag, frag, sizeof(GLNVGfragUniforms)) != 0) {
+		gl->boundUniforms = uniformOffset;
+		memcpy(&gl->boundFrag, frag, sizeof(GLNVGfragUniforms));
+		glUniform4fv(gl->shader.loc[GLNVG_LOC_FRAG], NANOVG_GL_UNIFORMARRAY_SIZE, &(frag->uniformArray[0][0]));
+		gl->nglCalls++;
+	} else {
+		gl->nglCallsSaved++;
+	}
 #endif
 
 	if (image != 0) {
@@ -1008,10 +1090,58 @@ static void glnvg__renderViewport(void* uptr, float width, float height, float d
 	gl->view[1] = height;
 }
 
+// Draws the fill or the stroke range of each path, last path first if `reverse`, all in one
+// glMultiDrawArrays where there is one.
+static void glnvg__drawPaths(GLNVGcontext* gl, GLenum mode, const GLNVGpath* paths, int npaths, int fill, int reverse)
+{
+	int i, n = 0;
+#if NANOVG_GL_USE_MULTIDRAW
+	if (npaths > gl->cdraws) {
+		GLint* firsts;
+		GLsizei* counts;
+		int cdraws = glnvg__maxi(npaths, 128) + gl->cdraws/2; // 1.5x Overallocate
+		firsts = (GLint*)realloc(gl->drawFirsts, sizeof(GLint) * cdraws);
+		if (firsts != NULL) gl->drawFirsts = firsts;
+		counts = (GLsizei*)realloc(gl->drawCounts, sizeof(GLsizei) * cdraws);
+		if (counts != NULL) gl->drawCounts = counts;
+		if (firsts != NULL && counts != NULL) gl->cdraws = cdraws;
+	}
+	if (npaths <= gl->cdraws) {
+		for (i = 0; i < npaths; i++) {
+			const GLNVGpath* path = &paths[reverse ? npaths-1 - i : i];
+			int count = fill ? path->fillCount : path->strokeCount;
+			if (count == 0) continue;
+			gl->drawFirsts[n] = fill ? path->fillOffset : path->strokeOffset;
+			gl->drawCounts[n] = count;
+			n++;
+		}
+		if (n == 1)
+			glDrawArrays(mode, gl->drawFirsts[0], gl->drawCounts[0]);
+		else if (n > 1)
+			glMultiDrawArrays(mode, gl->drawFirsts, gl->drawCounts, n);
+		if (n > 0) {
+			gl->nglCalls++;
+			gl->nglCallsSaved += n - 1;
+		}
+		return;
+	}
+#endif
+	// No multi draw, or no memory for it.
+	for (i = 0; i < npaths; i++) {
+		const GLNVGpath* path = &paths[reverse ? npaths-1 - i : i];
+		if (fill)
+			glDrawArrays(mode, path->fillOffset, path->fillCount);
+		else
+			glDrawArrays(mode, path->strokeOffset, path->strokeCount);
+		gl->nglCalls++;
+	}
+	NVG_NOTUSED(n);
+}
+
 static void glnvg__fill(GLNVGcontext* gl, GLNVGcall* call)
 {
 	GLNVGpath* paths = &gl->paths[call->pathOffset];
-	int i, npaths = call->pathCount;
+	int npaths = call->pathCount;
 
 	// Draw shapes
 	glEnable(GL_STENCIL_TEST);
@@ -1026,8 +1156,7 @@ static void glnvg__fill(GLNVGcontext* gl, GLNVGcall* call)
 	glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
 	glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
 	glDisable(GL_CULL_FACE);
-	for (i = 0; i < npaths; i++)
-		glDrawArrays(GL_TRIANGLE_FAN, paths[i].fillOffset, paths[i].fillCount);
+	glnvg__drawPaths(gl, GL_TRIANGLE_FAN, paths, npaths, 1, 0);
 	glEnable(GL_CULL_FACE);
 
 	// Draw anti-aliased pixels
@@ -1040,14 +1169,14 @@ static void glnvg__fill(GLNVGcontext* gl, GLNVGcall* call)
 		glnvg__stencilFunc(gl, GL_EQUAL, 0x00, 0xff);
 		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 		// Draw fringes
-		for (i = 0; i < npaths; i++)
-			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, paths, npaths, 0, 0);
 	}
 
 	// Draw fill
 	glnvg__stencilFunc(gl, GL_NOTEQUAL, 0x0, 0xff);
 	glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
 	glDrawArrays(GL_TRIANGLE_STRIP, call->triangleOffset, call->triangleCount);
+	gl->nglCalls++;
 
 	glDisable(GL_STENCIL_TEST);
 }
@@ -1060,11 +1189,14 @@ static void glnvg__convexFill(GLNVGcontext* gl, GLNVGcall* call)
 	glnvg__setUniforms(gl, call->uniformOffset, call->image);
 	glnvg__checkError(gl, "convex fill");
 
+	// Fans and fringes alternate, so that each path's fringe is drawn over the path before.
 	for (i = 0; i < npaths; i++) {
 		glDrawArrays(GL_TRIANGLE_FAN, paths[i].fillOffset, paths[i].fillCount);
+		gl->nglCalls++;
 		// Draw fringes
 		if (paths[i].strokeCount > 0) {
 			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+			gl->nglCalls++;
 		}
 	}
 }
@@ -1072,7 +1204,7 @@ static void glnvg__convexFill(GLNVGcontext* gl, GLNVGcall* call)
 static void glnvg__stroke(GLNVGcontext* gl, GLNVGcall* call)
 {
 	GLNVGpath* paths = &gl->paths[call->pathOffset];
-	int npaths = call->pathCount, i;
+	int npaths = call->pathCount;
 
 	if (gl->flags & NVG_STENCIL_STROKES) {
 
@@ -1084,23 +1216,20 @@ static void glnvg__stroke(GLNVGcontext* gl, GLNVGcall* call)
 		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
 		glnvg__setUniforms(gl, call->uniformOffset + gl->fragSize, call->image);
 		glnvg__checkError(gl, "stroke fill 0");
-		for (i = 0; i < npaths; i++)
-			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, paths, npaths, 0, 0);
 
 		// Draw anti-aliased pixels.
 		glnvg__setUniforms(gl, call->uniformOffset, call->image);
 		glnvg__stencilFunc(gl, GL_EQUAL, 0x00, 0xff);
 		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-		for (i = 0; i < npaths; i++)
-			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, paths, npaths, 0, 0);
 
 		// Clear stencil buffer.
 		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 		glnvg__stencilFunc(gl, GL_ALWAYS, 0x0, 0xff);
 		glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
 		glnvg__checkError(gl, "stroke fill 1");
-		for (i = 0; i < npaths; i++)
-			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, paths, npaths, 0, 0);
 		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
 		glDisable(GL_STENCIL_TEST);
@@ -1111,9 +1240,44 @@ static void glnvg__stroke(GLNVGcontext* gl, GLNVGcall* call)
 		glnvg__setUniforms(gl, call->uniformOffset, call->image);
 		glnvg__checkError(gl, "stroke fill");
 		// Draw Strokes
-		for (i = 0; i < npaths; i++)
-			glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset, paths[i].strokeCount);
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, paths, npaths, 0, 0);
+	}
+}
+
+static void glnvg__batchStroke(GLNVGcontext* gl, GLNVGcall* call)
+{
+	if ((gl->flags & NVG_DEPTH_STROKES) && call->pathCount > 0 && call->pathCount <= gl->depthPaths) {
+		// Opaque cores first, last stroke first, writing depth. Later strokes are nearer, so a
+		// covered fragment fails the depth test instead of being shaded and blended over.
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_BLEND);
+		glnvg__setUniforms(gl, call->uniformOffset + gl->fragSize, 0);
+		glnvg__checkError(gl, "batch stroke cores");
+		glnvg__drawPaths(gl, GL_TRIANGLE_STRIP, &gl->paths[call->pathOffset], call->pathCount, 0, 1);
+		glEnable(GL_BLEND);
+
+		// Then all of each stroke in order, blended over the strokes below. Cores above hide it,
+		// and its own core is at its own depth, so only the fringes are drawn. Without
+		// antialiasing there are none.
+		if (gl->flags & NVG_ANTIALIAS) {
+			glDepthMask(GL_FALSE);
+			glnvg__setUniforms(gl, call->uniformOffset, 0);
+			glnvg__checkError(gl, "batch stroke fringes");
+			glDrawArrays(GL_TRIANGLE_STRIP, call->triangleOffset, call->triangleCount);
+			gl->nglCalls++;
+		}
+		glDisable(GL_DEPTH_TEST);
+		return;
 	}
+
+	glnvg__setUniforms(gl, call->uniformOffset, 0);
+	glnvg__checkError(gl, "batch stroke");
+
+	glDrawArrays(GL_TRIANGLE_STRIP, call->triangleOffset, call->triangleCount);
+	gl->nglCalls++;
 }
 
 static void glnvg__triangles(GLNVGcontext* gl, GLNVGcall* call)
@@ -1122,6 +1286,32 @@ static void glnvg__triangles(GLNVGcontext* gl, GLNVGcall* call)
 	glnvg__checkError(gl, "triangles fill");
 
 	glDrawArrays(GL_TRIANGLES, call->triangleOffset, call->triangleCount);
+	gl->nglCalls++;
+}
+
+// Extends call `into` by `next` if they draw the same way one after the other, only different
+// geometry. Stencil fills and strokes are left alone, since together they would cover each other.
+static int glnvg__mergeCall(GLNVGcontext* gl, GLNVGcall* into, const GLNVGcall* next)
+{
+	if (next->type != into->type || next->image != into->image ||
+		memcmp(&next->blendFunc, &into->blendFunc, sizeof(GLNVGblend)) != 0)
+		return 0;
+	if (next->type == GLNVG_CONVEXFILL ||
+		(next->type == GLNVG_STROKE && (gl->flags & NVG_STENCIL_STROKES) == 0)) {
+		if (next->pathOffset != into->pathOffset + into->pathCount) return 0;
+	} else if (next->type == GLNVG_TRIANGLES) {
+		if (next->triangleOffset != into->triangleOffset + into->triangleCount) return 0;
+	} else {
+		return 0;
+	}
+	if (memcmp(nvg__fragUniformPtr(gl, next->uniformOffset), nvg__fragUniformPtr(gl, into->uniformOffset),
+			   sizeof(GLNVGfragUniforms)) != 0)
+		return 0;
+	into->pathCount += next->pathCount;
+	into->triangleCount += next->triangleCount;
+	// Its uniforms and texture are not set again, and triangles are drawn together.
+	gl->nglCallsSaved += next->type == GLNVG_TRIANGLES ? 2 : 1;
+	return 1;
 }
 
 static void glnvg__renderCancel(void* uptr) {
@@ -1176,10 +1366,40 @@ static GLNVGblend glnvg__blendCompositeOperation(NVGcompositeOperationState op)
 	return blend;
 }
 
+// Gives each path of a batch a depth, nearer for later paths, 2 steps of the depth buffer apart.
+static void glnvg__strokeDepths(GLNVGcontext* gl)
+{
+	GLint bits = 24;
+	float step;
+	int i, j, k;
+
+#ifdef GL_DEPTH_BITS
+	glGetIntegerv(GL_DEPTH_BITS, &bits);
+#endif
+	if (bits > 24) bits = 24;
+	if (bits < 2) {
+		gl->depthPaths = 0;
+		return;
+	}
+	// Clip space spans 2, so a step of the depth buffer is 2 / 2^bits in it.
+	gl->depthPaths = (1 << (bits-1)) - 1;
+	step = 4.0f / (float)(1 << bits);
+	for (i = 0; i < gl->ncalls; i++) {
+		GLNVGcall* call = &gl->calls[i];
+		if (call->type != GLNVG_BATCHSTROKE || call->pathCount > gl->depthPaths) continue;
+		for (j = 0; j < call->pathCount; j++) {
+			const GLNVGpath* path = &gl->paths[call->pathOffset + j];
+			float z = 1.0f - step * (j+1);
+			for (k = 0; k < path->strokeCount; k++)
+				gl->depths[path->strokeOffset + k] = z;
+		}
+	}
+}
+
 static void glnvg__renderFlush(void* uptr)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
-	int i;
+	int i, j;
 
 	if (gl->ncalls > 0) {
 
@@ -1191,7 +1411,8 @@ static void glnvg__renderFlush(void* uptr)
 		glFrontFace(GL_CCW);
 		glEnable(GL_BLEND);
 		glDisable(GL_DEPTH_TEST);
-		glDisable(GL_SCISSOR_TEST);
+		// the scissor test is left to the caller, which clips frames
+		// to what changed.
 		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 		glStencilMask(0xffffffff);
 		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
@@ -1209,6 +1430,7 @@ static void glnvg__renderFlush(void* uptr)
 		gl->blendFunc.dstRGB = GL_INVALID_ENUM;
 		gl->blendFunc.dstAlpha = GL_INVALID_ENUM;
 		#endif
+		gl->boundUniforms = -1;
 
 #if NANOVG_GL_USE_UNIFORMBUFFER
 		// Upload ubo for frag shaders
@@ -1221,11 +1443,24 @@ static void glnvg__renderFlush(void* uptr)
 		glBindVertexArray(gl->vertArr);
 #endif
 		glBindBuffer(GL_ARRAY_BUFFER, gl->vertBuf);
-		glBufferData(GL_ARRAY_BUFFER, gl->nverts * sizeof(NVGvertex), gl->verts, GL_STREAM_DRAW);
+		// Colors, and depths if there are any, follow the vertices in the same buffer.
+		glBufferData(GL_ARRAY_BUFFER, gl->nverts * (sizeof(NVGvertex) + sizeof(unsigned int) + (gl->depths != NULL ? sizeof(float) : 0)), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, gl->nverts * sizeof(NVGvertex), gl->verts);
+		glBufferSubData(GL_ARRAY_BUFFER, gl->nverts * sizeof(NVGvertex), gl->nverts * sizeof(unsigned int), gl->colors);
 		glEnableVertexAttribArray(0);
 		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(size_t)0);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(0 + 2*sizeof(float)));
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(unsigned int), (const GLvoid*)(gl->nverts * sizeof(NVGvertex)));
+		if (gl->depths != NULL) {
+			glnvg__strokeDepths(gl);
+			glBufferSubData(GL_ARRAY_BUFFER, gl->nverts * (sizeof(NVGvertex) + sizeof(unsigned int)), gl->nverts * sizeof(float), gl->depths);
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (const GLvoid*)(gl->nverts * (sizeof(NVGvertex) + sizeof(unsigned int))));
+		} else {
+			glVertexAttrib1f(3, 0.0f);
+		}
 
 		// Set view and texture just once per frame.
 		glUniform1i(gl->shader.loc[GLNVG_LOC_TEX], 0);
@@ -1235,8 +1470,11 @@ static void glnvg__renderFlush(void* uptr)
 		glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
 #endif
 
-		for (i = 0; i < gl->ncalls; i++) {
-			GLNVGcall* call = &gl->calls[i];
+		for (i = 0; i < gl->ncalls; i = j) {
+			GLNVGcall merged = gl->calls[i];
+			GLNVGcall* call = &merged;
+			for (j = i + 1; j < gl->ncalls && glnvg__mergeCall(gl, call, &gl->calls[j]); j++)
+				;
 			glnvg__blendFuncSeparate(gl,&call->blendFunc);
 			if (call->type == GLNVG_FILL)
 				glnvg__fill(gl, call);
@@ -1246,10 +1484,14 @@ static void glnvg__renderFlush(void* uptr)
 				glnvg__stroke(gl, call);
 			else if (call->type == GLNVG_TRIANGLES)
 				glnvg__triangles(gl, call);
+			else if (call->type == GLNVG_BATCHSTROKE)
+				glnvg__batchStroke(gl, call);
 		}
 
 		glDisableVertexAttribArray(0);
 		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(2);
+		glDisableVertexAttribArray(3);
 #if defined NANOVG_GL3
 		glBindVertexArray(0);
 #endif
@@ -1313,14 +1555,27 @@ static int glnvg__allocVerts(GLNVGcontext* gl, int n)
 	int ret = 0;
 	if (gl->nverts+n > gl->cverts) {
 		NVGvertex* verts;
+		unsigned int* colors;
 		int cverts = glnvg__maxi(gl->nverts + n, 4096) + gl->cverts/2; // 1.5x Overallocate
 		verts = (NVGvertex*)realloc(gl->verts, sizeof(NVGvertex) * cverts);
 		if (verts == NULL) return -1;
 		gl->verts = verts;
+		colors = (unsigned int*)realloc(gl->colors, sizeof(unsigned int) * cverts);
+		if (colors == NULL) return -1;
+		gl->colors = colors;
+		if (gl->flags & NVG_DEPTH_STROKES) {
+			float* depths = (float*)realloc(gl->depths, sizeof(float) * cverts);
+			if (depths == NULL) return -1;
+			gl->depths = depths;
+		}
 		gl->cverts = cverts;
 	}
 	ret = gl->nverts;
 	gl->nverts += n;
+	// White, which leaves the paint as it is.
+	memset(&gl->colors[ret], 0xff, sizeof(unsigned int) * n);
+	if (gl->depths != NULL)
+		memset(&gl->depths[ret], 0, sizeof(float) * n);
 	return ret;
 }
 
@@ -1435,13 +1690,135 @@ error:
 	if (gl->ncalls > 0) gl->ncalls--;
 }
 
+static unsigned int glnvg__packColor(NVGcolor c)
+{
+	unsigned char rgba[4];
+	unsigned int packed;
+	rgba[0] = (unsigned char)(c.r * 255.0f + 0.5f);
+	rgba[1] = (unsigned char)(c.g * 255.0f + 0.5f);
+	rgba[2] = (unsigned char)(c.b * 255.0f + 0.5f);
+	rgba[3] = (unsigned char)(c.a * 255.0f + 0.5f);
+	memcpy(&packed, rgba, sizeof(packed));
+	return packed;
+}
+
+// Draws an opaque stroke of a solid color as part of the last call, if that is a batch it fits
+// in, or else starts a batch. A batch is one triangle strip: the strokes' strips are joined by
+// degenerate triangles, and their colors go in the vertices, so strokes that differ only in color
+// share the uniforms. Returns 0 if the stroke cannot be batched.
+static int glnvg__renderBatchStroke(GLNVGcontext* gl, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+									NVGscissor* scissor, float fringe, float strokeWidth, const NVGpath* paths, int npaths)
+{
+	GLNVGcall* call = gl->ncalls > 0 ? &gl->calls[gl->ncalls-1] : NULL;
+	GLNVGblend blend = glnvg__blendCompositeOperation(compositeOperation);
+	GLNVGfragUniforms frag;
+	NVGpaint white;
+	unsigned int color;
+	int depth = (gl->flags & NVG_DEPTH_STROKES) != 0;
+	int i, j, count, nverts = 0, nstrokes = 0, offset, pathOffset = -1;
+
+	if ((gl->flags & NVG_BATCH_STROKES) == 0 || paint->image != 0) return 0;
+	// Overlaps within a stroke are drawn twice without the stencil, which only an opaque color hides.
+	if (memcmp(&paint->innerColor, &paint->outerColor, sizeof(NVGcolor)) != 0 || paint->innerColor.a < 1.0f)
+		return 0;
+
+	white = *paint;
+	white.innerColor = white.outerColor = nvgRGBAf(1, 1, 1, 1);
+	if (glnvg__convertPaint(gl, &frag, &white, scissor, strokeWidth, fringe, -1.0f) == 0) return 0;
+	// Where the paint is does not matter to a solid color.
+	memset(frag.paintMat, 0, sizeof(frag.paintMat));
+	frag.extent[0] = frag.extent[1] = 0.0f;
+	frag.radius = 0.0f;
+	frag.feather = 1.0f;
+
+	if (call != NULL && !(call->type == GLNVG_BATCHSTROKE &&
+						  call->triangleOffset + call->triangleCount == gl->nverts &&
+						  (!depth || call->pathOffset + call->pathCount == gl->npaths) &&
+						  memcmp(&call->blendFunc, &blend, sizeof(blend)) == 0 &&
+						  memcmp(nvg__fragUniformPtr(gl, call->uniformOffset), &frag, sizeof(frag)) == 0))
+		call = NULL;
+	if (call == NULL) {
+		call = glnvg__allocCall(gl);
+		if (call == NULL) return 1;
+		call->type = GLNVG_BATCHSTROKE;
+		call->blendFunc = blend;
+		call->triangleOffset = gl->nverts;
+		call->pathOffset = gl->npaths;
+		call->uniformOffset = glnvg__allocFragUniforms(gl, depth ? 2 : 1);
+		if (call->uniformOffset == -1) {
+			gl->ncalls--;
+			return 1;
+		}
+		memcpy(nvg__fragUniformPtr(gl, call->uniformOffset), &frag, sizeof(frag));
+		if (depth) {
+			// The cores: only what the stroke covers fully.
+			frag.strokeThr = 1.0f - 0.5f/255.0f;
+			memcpy(nvg__fragUniformPtr(gl, call->uniformOffset + gl->fragSize), &frag, sizeof(frag));
+		}
+	}
+
+	// Each strip after the first is joined by repeating the vertices on either side of the seam,
+	// and one more if that keeps it starting on an even vertex, which keeps its winding.
+	count = call->triangleCount;
+	for (i = 0; i < npaths; i++) {
+		if (paths[i].nstroke == 0) continue;
+		if (count > 0) {
+			nverts += 2 + (count & 1);
+			count += 2 + (count & 1);
+		}
+		nverts += paths[i].nstroke;
+		count += paths[i].nstroke;
+		nstrokes++;
+	}
+	offset = glnvg__allocVerts(gl, nverts);
+	if (offset == -1) return 1;
+	// With depth, each strip is also a path, drawn on its own in the cores' pass.
+	if (depth) {
+		pathOffset = glnvg__allocPaths(gl, nstrokes);
+		if (pathOffset == -1) return 1;
+	}
+
+	color = glnvg__packColor(glnvg__premulColor(paint->innerColor));
+	for (i = 0; i < npaths; i++) {
+		const NVGpath* path = &paths[i];
+		if (path->nstroke == 0) continue;
+		if (call->triangleCount > 0) {
+			int seam = 2 + (call->triangleCount & 1);
+			for (j = 0; j < seam - 1; j++)
+				gl->verts[offset + j] = gl->verts[offset - 1];
+			gl->verts[offset + seam - 1] = path->stroke[0];
+			for (j = 0; j < seam; j++)
+				gl->colors[offset + j] = gl->colors[offset - 1];
+			offset += seam;
+			call->triangleCount += seam;
+		}
+		memcpy(&gl->verts[offset], path->stroke, sizeof(NVGvertex) * path->nstroke);
+		for (j = 0; j < path->nstroke; j++)
+			gl->colors[offset + j] = color;
+		if (depth) {
+			GLNVGpath* copy = &gl->paths[pathOffset++];
+			memset(copy, 0, sizeof(GLNVGpath));
+			copy->strokeOffset = offset;
+			copy->strokeCount = path->nstroke;
+			call->pathCount++;
+		}
+		offset += path->nstroke;
+		call->triangleCount += path->nstroke;
+	}
+	return 1;
+}
+
 static void glnvg__renderStroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
 								float strokeWidth, const NVGpath* paths, int npaths)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
-	GLNVGcall* call = glnvg__allocCall(gl);
+	GLNVGcall* call;
 	int i, maxverts, offset;
 
+	if (glnvg__renderBatchStroke(gl, paint, compositeOperation, scissor, fringe, strokeWidth, paths, npaths))
+		return;
+
+	call = glnvg__allocCall(gl);
 	if (call == NULL) return;
 
 	call->type = GLNVG_STROKE;
@@ -1553,8 +1930,12 @@ static void glnvg__renderDelete(void* uptr)
 
 	free(gl->paths);
 	free(gl->verts);
+	free(gl->colors);
+	free(gl->depths);
 	free(gl->uniforms);
 	free(gl->calls);
+	free(gl->drawFirsts);
+	free(gl->drawCounts);
 
 	free(gl);
 }
@@ -1657,4 +2038,13 @@ GLuint nvglImageHandleGLES3(NVGcontext* ctx, int image)
 	return tex->tex;
 }
 
+void nvglRenderStats(NVGcontext* ctx, int* glCalls, int* glCallsSaved)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)nvgInternalParams(ctx)->userPtr;
+	if (glCalls != NULL) *glCalls = gl->nglCalls;
+	if (glCallsSaved != NULL) *glCallsSaved = gl->nglCallsSaved;
+	gl->nglCalls = 0;
+	gl->nglCallsSaved = 0;
+}
+
 #endif /* NANOVG_GL_IMPLEMENTATION */
@@ -0,0 +1,271 @@
+#include "overview.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "assert.h"
+#include "spatial-hash.h"
+
+Box OverviewPyramid::tile_box(const Key &k) {
+    const int sz = TILE * texel_size(k.level);
+    return Box(V2<int>(k.tx * sz, k.ty * sz),
+               V2<int>((k.tx + 1) * sz - 1, (k.ty + 1) * sz - 1));
+}
+
+void OverviewPyramid::invalidate(const Box &box) {
+    if (box.empty()) {
+        return;
+    }
+    const int sz = TILE * TEXEL;
+    for (int tx = floor_div(box.lo.x, sz); tx <= floor_div(box.hi.x, sz);
+         ++tx) {
+        for (int ty = floor_div(box.lo.y, sz); ty <= floor_div(box.hi.y, sz);
+             ++ty) {
+            Key k;
+            k.tx = tx;
+            k.ty = ty;
+            dirty_base.insert(k);
+        }
+    }
+}
+
+void OverviewPyramid::begin_tile(const Key &k) {
+    assert(k.level == 0);
+    cur = k;
+    raster.assign(TILE * TILE * 4, 0);
+}
+
+static bool blank(const unsigned char *rgba, int n) {
+    for (int i = 3; i < n * n * 4; i += 4) {
+        if (rgba[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// average the 2x2 texels of the n x n texels at `src`, rows `src_stride`
+// texels apart, into the n/2 x n/2 at `dst`, weighing colors by alpha.
+static void halve(const unsigned char *src, int src_stride, int n,
+                  unsigned char *dst, int dst_stride) {
+    for (int y = 0; y < n / 2; ++y) {
+        for (int x = 0; x < n / 2; ++x) {
+            int r = 0, g = 0, b = 0, a = 0;
+            for (int s = 0; s < 4; ++s) {
+                const unsigned char *p =
+                    src + 4 * ((2 * y + s / 2) * src_stride + 2 * x + s % 2);
+                r += p[0] * p[3];
+                g += p[1] * p[3];
+                b += p[2] * p[3];
+                a += p[3];
+            }
+            unsigned char *d = dst + 4 * (y * dst_stride + x);
+            d[0] = a ? r / a : 0;
+            d[1] = a ? g / a : 0;
+            d[2] = a ? b / a : 0;
+            d[3] = (a + 2) / 4;
+        }
+    }
+}
+
+OverviewPyramid::Key OverviewPyramid::up_to(const Key &k, int level) {
+    Key up;
+    up.level = level;
+    up.tx = floor_div(k.tx, 1 << (level - k.level));
+    up.ty = floor_div(k.ty, 1 << (level - k.level));
+    return up;
+}
+
+// `raster` is tile `k` of level 0 drawn again: filter it into the tiles
+// above, down to CPU_LEVEL.
+void OverviewPyramid::end_tile(const Key &k) {
+    assert(k.level == 0);
+    int n = TILE;
+    block.swap(raster);
+    set_block(k, k, n, block.data());
+    for (int level = 1; level <= CPU_LEVEL; ++level) {
+        halved.resize(n / 2 * n / 2 * 4);
+        halve(block.data(), n, n, halved.data(), n / 2);
+        block.swap(halved);
+        n /= 2;
+        set_block(up_to(k, level), k, n, block.data());
+    }
+}
+
+void OverviewPyramid::set_block(const Key &k, const Key &base, int n,
+                                const unsigned char *src) {
+    const int ox = (base.tx - (k.tx << k.level)) * n;
+    const int oy = (base.ty - (k.ty << k.level)) * n;
+    if (k.level >= CPU_LEVEL) {
+        auto it = tiles.find(k);
+        if (it == tiles.end() && blank(src, n)) {
+            return;
+        }
+        Tile &t = tiles[k];
+        t.rgba.resize(TILE * TILE * 4);
+        for (int y = 0; y < n; ++y) {
+            std::copy(src + 4 * y * n, src + 4 * (y + 1) * n,
+                      t.rgba.begin() + 4 * ((oy + y) * TILE + ox));
+        }
+        t.uploaded = false;
+        if (blank(t.rgba.data(), TILE)) {
+            erase(k);
+        }
+        if (k.level + 1 < NLEVELS) {
+            dirty_up.insert(up_to(k, k.level + 1));
+        }
+        return;
+    }
+
+    // below CPU_LEVEL a tile exists while it has ink: level 0 if the
+    // block has some, the levels above if one of their children exists.
+    bool ink = false;
+    if (k.level == 0) {
+        ink = !blank(src, n);
+    }
+    for (int q = 0; q < 4 && k.level > 0 && !ink; ++q) {
+        Key c;
+        c.level = k.level - 1;
+        c.tx = 2 * k.tx + q % 2;
+        c.ty = 2 * k.ty + q / 2;
+        ink = tiles.count(c) > 0;
+    }
+    if (!ink) {
+        erase(k);
+        return;
+    }
+    Tile &t = tiles[k];
+    region.resize(TILE * TILE * 4);
+    if (t.image == -1) {
+        std::fill(region.begin(), region.end(), 0);
+    }
+    for (int y = 0; y < n; ++y) {
+        std::copy(src + 4 * y * n, src + 4 * (y + 1) * n,
+                  region.begin() + 4 * ((oy + y) * TILE + ox));
+    }
+    if (t.image == -1) {
+        t.image = vg_create_image(TILE, TILE, region.data());
+    } else {
+        vg_update_image_region(t.image, ox, oy, n, n, region.data());
+    }
+}
+
+// keep `raster` as tile `k`, or drop the tile if it is blank, and mark the
+// tile above it dirty.
+void OverviewPyramid::keep(const Key &k) {
+    if (blank(raster.data(), TILE)) {
+        erase(k);
+    } else {
+        Tile &t = tiles[k];
+        t.rgba.swap(raster);
+        t.uploaded = false;
+    }
+    if (k.level + 1 < NLEVELS) {
+        dirty_up.insert(up_to(k, k.level + 1));
+    }
+}
+
+void OverviewPyramid::filter_levels() {
+    // a tile sorts before the tile above it, so the set is done bottom up,
+    // and the tiles above that are marked on the way are done too. Only
+    // tiles from CPU_LEVEL up are filtered here, from their children's
+    // texels.
+    const int half = TILE / 2;
+    for (auto it = dirty_up.begin(); it != dirty_up.end();
+         it = dirty_up.erase(it)) {
+        const Key k = *it;
+        assert(k.level > CPU_LEVEL);
+        raster.assign(TILE * TILE * 4, 0);
+        for (int q = 0; q < 4; ++q) {
+            Key c;
+            c.level = k.level - 1;
+            c.tx = 2 * k.tx + q % 2;
+            c.ty = 2 * k.ty + q / 2;
+            auto child = tiles.find(c);
+            if (child == tiles.end()) {
+                continue;
+            }
+            halve(child->second.rgba.data(), TILE, TILE,
+                  raster.data() + 4 * (q / 2 * half * TILE + q % 2 * half),
+                  TILE);
+        }
+        keep(k);
+    }
+}
+
+void OverviewPyramid::erase(const Key &k) {
+    auto it = tiles.find(k);
+    if (it == tiles.end()) {
+        return;
+    }
+    if (it->second.image != -1) {
+        vg_delete_image(it->second.image);
+    }
+    tiles.erase(it);
+}
+
+void OverviewPyramid::line(V2<int> a, V2<int> b, int width, Color c) {
+    // in texels of the tile being drawn.
+    const V2<int> origin = tile_box(cur).lo;
+    const V2<float> fa = (a - origin).cast<float>() / TEXEL;
+    const V2<float> fb = (b - origin).cast<float>() / TEXEL;
+    const float r = std::max<float>(0.5, 0.5 * width / TEXEL);
+    if (std::max(fa.x, fb.x) + r < 0 || std::min(fa.x, fb.x) - r > TILE ||
+        std::max(fa.y, fb.y) + r < 0 || std::min(fa.y, fb.y) - r > TILE) {
+        return;
+    }
+    // stamp a disc every half texel.
+    const int n = std::max<int>(1, ceil(2 * sqrt((fb - fa).lensq())));
+    for (int i = 0; i <= n; ++i) {
+        const V2<float> p = fa + (float(i) / n) * (fb - fa);
+        const int x0 = std::max<int>(0, floor(p.x - r));
+        const int x1 = std::min<int>(TILE - 1, floor(p.x + r));
+        const int y0 = std::max<int>(0, floor(p.y - r));
+        const int y1 = std::min<int>(TILE - 1, floor(p.y + r));
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                const V2<float> d = V2<float>(x + 0.5, y + 0.5) - p;
+                if (d.lensq() > r * r) {
+                    continue;
+                }
+                unsigned char *t = raster.data() + 4 * (y * TILE + x);
+                t[0] = c.r;
+                t[1] = c.g;
+                t[2] = c.b;
+                t[3] = 255;
+            }
+        }
+    }
+}
+
+void OverviewPyramid::draw(const Box &viewport, V2<int> pan, float zoom) {
+    // the coarsest level whose texels are no bigger than a pixel.
+    int level = 0;
+    while (level + 1 < NLEVELS && texel_size(level + 1) * zoom <= 1) {
+        level++;
+    }
+    const int sz = TILE * texel_size(level);
+    Key lo, hi;
+    lo.level = hi.level = level;
+    hi.ty = floor_div(viewport.hi.y, sz);
+    for (int tx = floor_div(viewport.lo.x, sz);
+         tx <= floor_div(viewport.hi.x, sz); ++tx) {
+        lo.tx = hi.tx = tx;
+        lo.ty = floor_div(viewport.lo.y, sz);
+        for (auto it = tiles.lower_bound(lo);
+             it != tiles.end() && !(hi < it->first); ++it) {
+            // tiles below CPU_LEVEL are images already.
+            Tile &t = it->second;
+            if (t.image == -1) {
+                t.image = vg_create_image(TILE, TILE, t.rgba.data());
+            } else if (!t.uploaded && !t.rgba.empty()) {
+                vg_update_image(t.image, t.rgba.data());
+            }
+            t.uploaded = true;
+            const V2<int> o = tile_box(it->first).lo - pan;
+            vg_draw_image(t.image, zoom * o.x, zoom * o.y, zoom * sz,
+                          zoom * sz);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <map>
+#include <set>
+#include <vector>
+
+#include "quadtree.h"
+#include "vector-graphics.h"
+
+// Raster of the whole board at a few resolutions, for the overview.
+// Drawing every stroke at overview zoom is the slowest frame there is, and
+// most of what it draws is smaller than a pixel. The pyramid keeps the
+// board as RGBA tiles of TILE x TILE texels instead. A texel of level 0
+// covers TEXEL x TEXEL world pixels, and every level up halves the
+// resolution. Only tiles with ink exist.
+// Changed ink only marks the tiles under it dirty. A dirty tile of level 0
+// is drawn again from the strokes in it, and one of a level above is
+// filtered down from the four tiles below it, so the overview costs one
+// image per tile on screen.
+// Tiles below CPU_LEVEL are only kept as images: a redrawn tile of level 0
+// is filtered straight into the images above it, a block of half the size
+// per level, down to a block of CPU_LEVEL's texels. From there up tiles
+// keep their texels, which the next level is filtered from.
+struct OverviewPyramid {
+    static const int TILE = 64;
+    static const int TEXEL = 4;
+    static const int NLEVELS = 8;
+    static const int CPU_LEVEL = 3;
+
+    // the ink in world box `box` changed.
+    void invalidate(const Box &box);
+
+    // redraw at most `budget` dirty tiles of level 0, all of them if -1,
+    // then the levels above. Tiles not redrawn yet show what they held. `draw(box)` draws the ink in world box `box`
+    // with line(), and returns false if some of it is not in memory yet:
+    // that tile is tried again by the next update.
+    template <typename F>
+    void update(int budget, F draw) {
+        // go round from where the last update stopped, so that tiles
+        // waiting on the disk do not hold up the others.
+        auto it = dirty_base.lower_bound(resume);
+        for (int n = dirty_base.size(); n > 0 && budget != 0; --n, --budget) {
+            if (it == dirty_base.end()) {
+                it = dirty_base.begin();
+            }
+            begin_tile(*it);
+            if (draw(tile_box(*it))) {
+                end_tile(*it);
+                it = dirty_base.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (it != dirty_base.end()) {
+            resume = *it;
+        }
+        filter_levels();
+    }
+    // while a tile is redrawn: the piece from `a` to `b`, `width` wide.
+    void line(V2<int> a, V2<int> b, int width, Color c);
+
+    // draw the tiles that cover world box `viewport`, as seen from `pan`
+    // at `zoom`.
+    void draw(const Box &viewport, V2<int> pan, float zoom);
+
+   private:
+    struct Key {
+        int level = 0;
+        int tx = 0, ty = 0;
+        bool operator<(const Key &o) const {
+            return level < o.level ||
+                   (level == o.level &&
+                    (tx < o.tx || (tx == o.tx && ty < o.ty)));
+        }
+    };
+    struct Tile {
+        // from CPU_LEVEL up: TILE x TILE texels, row major, not
+        // premultiplied.
+        std::vector<unsigned char> rgba;
+        int image = -1;  // vg image, once drawn.
+        bool uploaded = false;
+    };
+
+    // world pixels covered by a texel of `level`.
+    static int texel_size(int level) { return TEXEL << level; }
+    static Box tile_box(const Key &k);
+    // the tile of `level` that `k` is in.
+    static Key up_to(const Key &k, int level);
+    void begin_tile(const Key &k);
+    void end_tile(const Key &k);
+    // set the block of `n` x `n` texels of tile `k` that level 0 tile
+    // `base` covers, from `src`.
+    void set_block(const Key &k, const Key &base, int n,
+                   const unsigned char *src);
+    // keep `raster` as tile `k` from CPU_LEVEL up.
+    void keep(const Key &k);
+    void filter_levels();
+    // drop tile `k`, if it exists.
+    void erase(const Key &k);
+
+    std::map<Key, Tile> tiles;
+    // tiles of level 0 to draw again, and of the levels above to filter.
+    std::set<Key> dirty_base;
+    std::set<Key> dirty_up;
+    // the dirty tile of level 0 the next update starts at.
+    Key resume;
+    // the tile being drawn again.
+    Key cur;
+    std::vector<unsigned char> raster;
+    // scratch of end_tile.
+    std::vector<unsigned char> block, halved, region;
+};
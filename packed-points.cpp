@@ -0,0 +1,67 @@
+#include "packed-points.h"
+
+#include "assert.h"
+
+// zigzag maps small negative and positive numbers to small unsigned ones:
+// 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static inline void put_varint(std::vector<uint8_t> &out, uint32_t u) {
+    while (u >= 0x80) {
+        out.push_back((uint8_t)(u | 0x80));
+        u >>= 7;
+    }
+    out.push_back((uint8_t)u);
+}
+
+static inline uint32_t get_varint(const uint8_t *&p) {
+    uint32_t u = *p & 0x7f;
+    int shift = 7;
+    while (*p++ & 0x80) {
+        u |= (uint32_t)(*p & 0x7f) << shift;
+        shift += 7;
+    }
+    return u;
+}
+
+void pack_points(const V2<int> *ps, int n, std::vector<uint8_t> &data,
+                 std::vector<uint64_t> &blocks) {
+    V2<int> prev;
+    for (int i = 0; i < n; ++i) {
+        if (i % PACK_BLOCK == 0) {
+            blocks.push_back(data.size());
+            prev = V2<int>(0, 0);
+        }
+        // deltas wrap around in unsigned arithmetic, so that even points
+        // far apart round trip.
+        put_varint(data, zigzag((int32_t)((uint32_t)ps[i].x - prev.x)));
+        put_varint(data, zigzag((int32_t)((uint32_t)ps[i].y - prev.y)));
+        prev = ps[i];
+    }
+}
+
+void unpack_points(const uint8_t *data, const uint64_t *blocks, int begin,
+                   int end, V2<int> *out) {
+    assert(0 <= begin && begin <= end);
+    // decoding starts from the block holding `begin`.
+    int i = begin / PACK_BLOCK * PACK_BLOCK;
+    const uint8_t *p = nullptr;
+    V2<int> cur;
+    for (; i < end; ++i) {
+        if (i % PACK_BLOCK == 0) {
+            p = data + blocks[i / PACK_BLOCK];
+            cur = V2<int>(0, 0);
+        }
+        cur.x = (int)((uint32_t)cur.x + (uint32_t)unzigzag(get_varint(p)));
+        cur.y = (int)((uint32_t)cur.y + (uint32_t)unzigzag(get_varint(p)));
+        if (i >= begin) {
+            out[i - begin] = cur;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+#include "vector-graphics.h"
+
+// Packed points of finished strokes.
+// Consecutive tablet samples are a few units apart, so each point is
+// stored as the zigzag varint of its delta from the previous one: one or
+// two bytes per coordinate instead of four. Points are packed in blocks of
+// PACK_BLOCK, each starting from an absolute point, so reading a point or
+// a short run decodes at most one block more than needed.
+static const int PACK_BLOCK = 32;
+
+// append the packed form of ps[0, n) to `data`, and the offset in `data`
+// of each of its blocks to `blocks`.
+void pack_points(const V2<int> *ps, int n, std::vector<uint8_t> &data,
+                 std::vector<uint64_t> &blocks);
+
+// decode points [begin, end) of a packed run whose blocks' offsets start
+// at `blocks`, into out[0, end - begin).
+void unpack_points(const uint8_t *data, const uint64_t *blocks, int begin,
+                   int end, V2<int> *out);
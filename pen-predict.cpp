@@ -0,0 +1,73 @@
+#include "pen-predict.h"
+
+#include <math.h>
+
+#include "assert.h"
+
+static float dot(V2<float> a, V2<float> b) { return a.x * b.x + a.y * b.y; }
+
+void PenPredictor::begin() { n = 0; }
+
+void PenPredictor::add(V2<int> p, float pressure, uint32_t ms) {
+    Sample s;
+    s.p = p.cast<float>();
+    s.pressure = pressure;
+    s.ms = ms;
+    if (n > 0 && ms - samples[n - 1].ms > STALE_MS) {
+        n = 0;
+    }
+    // a sample from the same millisecond replaces the last one, so that
+    // velocities never divide by zero.
+    if (n > 0 && ms == samples[n - 1].ms) {
+        samples[n - 1] = s;
+        return;
+    }
+    if (n == NSAMPLES) {
+        for (int i = 1; i < NSAMPLES; ++i) {
+            samples[i - 1] = samples[i];
+        }
+        n--;
+    }
+    samples[n++] = s;
+}
+
+bool PenPredictor::predict(uint32_t now, float ahead_ms,
+                           V2<int> &out) const {
+    if (n < 2) {
+        return false;
+    }
+    const Sample &last = samples[n - 1], &prev = samples[n - 2];
+    // signed: `now` may be a little behind the last sample.
+    if ((int32_t)(now - last.ms) > STALE_MS ||
+        last.pressure < prev.pressure) {
+        return false;
+    }
+    float h = ahead_ms;
+    if (last.pressure < LIGHT_PRESSURE) {
+        h *= last.pressure / LIGHT_PRESSURE;
+    }
+
+    // pixels per millisecond, and per millisecond squared.
+    const float dt1 = last.ms - prev.ms;
+    assert(dt1 > 0);
+    const V2<float> v1 = (last.p - prev.p) / dt1;
+    V2<float> a;
+    if (n == 3) {
+        const float dt0 = prev.ms - samples[0].ms;
+        assert(dt0 > 0);
+        const V2<float> v0 = (prev.p - samples[0].p) / dt0;
+        a = (v1 - v0) / (0.5f * (dt0 + dt1));
+    }
+
+    V2<float> d = h * v1 + (0.5f * h * h) * a;
+    if (dot(d, v1) < 0) {
+        d = h * v1;
+    }
+    const float len = sqrt(d.lensq());
+    if (len > MAX_PREDICT) {
+        d = d * (MAX_PREDICT / len);
+    }
+    const V2<float> p = last.p + d;
+    out = V2<int>(lroundf(p.x), lroundf(p.y));
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+#include "vector-graphics.h"
+
+// Guesses where the pen will be a little while after its last sample.
+// A sample takes a frame or more to reach the screen, so the live stroke
+// trails behind the nib. Drawing it on to the predicted position hides
+// that. The prediction is only ever drawn: the stroke keeps the real
+// samples, and the next frame predicts again from them.
+// The last three samples give a velocity and an acceleration, and the pen
+// is carried on along the parabola they describe, with
+// - no acceleration if that would turn the pen around, since a pen that
+//   slows down stops rather than reverses.
+// - no prediction while the pressure drops, since the pen is then lifting
+//   and the stroke is about to end where it is, and less of it below
+//   LIGHT_PRESSURE, where strokes start and end.
+// - at most MAX_PREDICT pixels of it, and none once the samples are
+//   STALE_MS apart, or the last one is STALE_MS old: a pen that holds
+//   still sends nothing, and must not be carried on.
+struct PenPredictor {
+    static const int MAX_PREDICT = 24;
+    static const int STALE_MS = 50;
+    static constexpr float LIGHT_PRESSURE = 0.2;
+
+    // start a new stroke.
+    void begin();
+    // the pen was at `p` with `pressure` at `ms` milliseconds.
+    void add(V2<int> p, float pressure, uint32_t ms);
+    // where the pen will be `ahead_ms` after its last sample, for a frame
+    // at `now` on the clock of the samples. false if there is nothing to
+    // predict.
+    bool predict(uint32_t now, float ahead_ms, V2<int> &out) const;
+
+   private:
+    struct Sample {
+        V2<float> p;
+        float pressure;
+        uint32_t ms;
+    };
+    // the last n samples, oldest first.
+    static const int NSAMPLES = 3;
+    Sample samples[NSAMPLES];
+    int n = 0;
+};
@@ -0,0 +1,122 @@
+#include "quadtree.h"
+
+Quadtree::Quadtree() {
+    Node root;
+    root.cx = root.cy = 0;
+    root.half = ROOT_HALF;
+    root.depth = 0;
+    nodes.push_back(root);
+}
+
+int Quadtree::find_node(const Box &bounds) {
+    assert(!bounds.empty());
+    const long long cx = ((long long)bounds.lo.x + bounds.hi.x) / 2;
+    const long long cy = ((long long)bounds.lo.y + bounds.hi.y) / 2;
+    const long long size = std::max<long long>(
+        (long long)bounds.hi.x - bounds.lo.x,
+        (long long)bounds.hi.y - bounds.lo.y);
+
+    // the root square is finite, but the root itself takes anything.
+    if (cx < -ROOT_HALF || cx >= ROOT_HALF || cy < -ROOT_HALF ||
+        cy >= ROOT_HALF) {
+        return 0;
+    }
+
+    int n = 0;
+    while (nodes[n].depth < MAX_DEPTH) {
+        const int child_half = nodes[n].half / 2;
+        // center in the child square, extent <= child_half: the box is
+        // inside the child's loose square of radius 2 * child_half.
+        if (size > child_half) {
+            break;
+        }
+        const int q = (cx >= nodes[n].cx) | ((cy >= nodes[n].cy) << 1);
+        if (nodes[n].child[q] == -1) {
+            Node c;
+            c.half = child_half;
+            c.cx = nodes[n].cx + ((q & 1) ? child_half : -child_half);
+            c.cy = nodes[n].cy + ((q & 2) ? child_half : -child_half);
+            c.depth = nodes[n].depth + 1;
+            c.parent = n;
+            nodes[n].child[q] = nodes.size();
+            // invalidates references into `nodes`.
+            nodes.push_back(c);
+        }
+        n = nodes[n].child[q];
+    }
+    return n;
+}
+
+void Quadtree::attach(int id, int n) {
+    Item &it = items[id];
+    it.node = n;
+    it.pos = nodes[n].items.size();
+    nodes[n].items.push_back(id);
+}
+
+void Quadtree::detach(int id) {
+    Item &it = items[id];
+    std::vector<int> &ids = nodes[it.node].items;
+    assert(ids[it.pos] == id);
+    ids[it.pos] = ids.back();
+    items[ids[it.pos]].pos = it.pos;
+    ids.pop_back();
+    it.node = -1;
+    it.pos = -1;
+}
+
+void Quadtree::refresh(int n) {
+    while (n != -1) {
+        Node &node = nodes[n];
+        Box ink;
+        for (int id : node.items) {
+            ink.add(items[id].ink);
+        }
+        for (int c : node.child) {
+            if (c != -1) {
+                ink.add(nodes[c].ink);
+            }
+        }
+        if (ink == node.ink) {
+            return;
+        }
+        node.ink = ink;
+        n = node.parent;
+    }
+}
+
+void Quadtree::insert(int id, Box bounds, Box ink) {
+    assert(id >= 0);
+    if (id >= (int)items.size()) {
+        items.resize(id + 1);
+    }
+    assert(items[id].node == -1 && "inserting item twice");
+    items[id].bounds = bounds;
+    items[id].ink = ink;
+    const int n = find_node(bounds);
+    attach(id, n);
+    refresh(n);
+}
+
+void Quadtree::update(int id, Box bounds, Box ink) {
+    assert(contains(id));
+    Item &it = items[id];
+    const int old = it.node;
+    it.bounds = bounds;
+    it.ink = ink;
+    const int n = find_node(bounds);
+    if (n != old) {
+        detach(id);
+        attach(id, n);
+        refresh(old);
+    }
+    refresh(n);
+}
+
+void Quadtree::remove(int id) {
+    assert(contains(id));
+    const int n = items[id].node;
+    detach(id);
+    items[id].ink = Box();
+    refresh(n);
+}
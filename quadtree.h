@@ -0,0 +1,126 @@
+#pragma once
+#include <limits.h>
+
+#include <vector>
+
+#include "assert.h"
+#include "vector-graphics.h"
+
+// axis aligned box, inclusive on both ends. starts out empty.
+struct Box {
+    V2<int> lo = V2<int>(INT_MAX, INT_MAX);
+    V2<int> hi = V2<int>(INT_MIN, INT_MIN);
+
+    Box(){};
+    Box(V2<int> lo, V2<int> hi) : lo(lo), hi(hi){};
+    static Box around(V2<int> p, int r) {
+        return Box(V2<int>(p.x - r, p.y - r), V2<int>(p.x + r, p.y + r));
+    }
+
+    bool empty() const { return lo.x > hi.x || lo.y > hi.y; }
+
+    void add(V2<int> p) {
+        lo.x = std::min(lo.x, p.x);
+        lo.y = std::min(lo.y, p.y);
+        hi.x = std::max(hi.x, p.x);
+        hi.y = std::max(hi.y, p.y);
+    }
+
+    void add(const Box &b) {
+        if (b.empty()) {
+            return;
+        }
+        add(b.lo);
+        add(b.hi);
+    }
+
+    bool intersects(const Box &b) const {
+        return !empty() && !b.empty() && lo.x <= b.hi.x && b.lo.x <= hi.x &&
+               lo.y <= b.hi.y && b.lo.y <= hi.y;
+    }
+
+    bool operator==(const Box &b) const {
+        return lo.x == b.lo.x && lo.y == b.lo.y && hi.x == b.hi.x &&
+               hi.y == b.hi.y;
+    }
+    bool operator!=(const Box &b) const { return !(*this == b); }
+};
+
+// Loose quadtree of boxes, addressed by caller-chosen dense integer ids.
+// Every item has two boxes:
+// - `bounds`: everything the item may ever cover. Decides where the item
+//   lives in the tree. Only grows, so items rarely move.
+// - `ink`: what the item covers right now (eg. after erasing). Every node
+//   caches the union of the ink below it, which prunes queries through
+//   erased regions and makes `ink_bounds` O(1).
+// An item lives in the deepest node whose loose box (twice the node's
+// square) contains its bounds. The root covers the whole plane: items that
+// do not fit under it stay at the root.
+struct Quadtree {
+    Quadtree();
+
+    void insert(int id, Box bounds, Box ink);
+    // `id` must be present. cost is O(depth) node refreshes.
+    void update(int id, Box bounds, Box ink);
+    void remove(int id);
+    bool contains(int id) const {
+        return id < (int)items.size() && items[id].node != -1;
+    }
+
+    // tight bounding box of all ink in the tree.
+    Box ink_bounds() const { return nodes[0].ink; }
+
+    // call f(id) for every item whose ink intersects `q`.
+    template <typename F>
+    void query(const Box &q, F f) const {
+        query_node(0, q, f);
+    }
+
+   private:
+    static const int ROOT_HALF = 1 << 24;
+    static const int MAX_DEPTH = 18;
+
+    struct Node {
+        int cx, cy, half;
+        int depth;
+        int parent = -1;
+        int child[4] = {-1, -1, -1, -1};
+        std::vector<int> items;
+        Box ink;
+    };
+
+    struct Item {
+        Box bounds;
+        Box ink;
+        int node = -1;  // -1 if not in the tree.
+        int pos = -1;   // index into nodes[node].items.
+    };
+
+    template <typename F>
+    void query_node(int n, const Box &q, F &f) const {
+        const Node &node = nodes[n];
+        if (!node.ink.intersects(q)) {
+            return;
+        }
+        for (int id : node.items) {
+            if (items[id].ink.intersects(q)) {
+                f(id);
+            }
+        }
+        for (int c : node.child) {
+            if (c != -1) {
+                query_node(c, q, f);
+            }
+        }
+    }
+
+    int find_node(const Box &bounds);
+    void attach(int id, int n);
+    void detach(int id);
+    // recompute cached ink of `n` and its ancestors, stopping early once a
+    // node's ink does not change.
+    void refresh(int n);
+
+    std::vector<Node> nodes;
+    std::vector<Item> items;
+};
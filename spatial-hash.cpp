@@ -0,0 +1,117 @@
+#include "spatial-hash.h"
+
+void SpatialHash::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.empty() ? 64 : 2 * old.size());
+    const unsigned mask = slots.size() - 1;
+    for (const Slot &s : old) {
+        if (s.bucket == -1) {
+            continue;
+        }
+        unsigned i = hash_cell(s.cx, s.cy) & mask;
+        while (slots[i].bucket != -1) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = s;
+    }
+}
+
+SpatialHash::Bucket &SpatialHash::find_or_create_bucket(int cx, int cy) {
+    const int ix = find_slot(cx, cy);
+    if (ix != -1) {
+        return buckets[slots[ix].bucket];
+    }
+
+    // keep load factor <= 1/2 so that probe sequences stay short.
+    if (2 * (nslots_used + 1) > (int)slots.size()) {
+        grow();
+    }
+
+    int bucket;
+    if (!free_buckets.empty()) {
+        bucket = free_buckets.back();
+        free_buckets.pop_back();
+    } else {
+        bucket = buckets.size();
+        buckets.push_back(Bucket());
+    }
+
+    const unsigned mask = slots.size() - 1;
+    unsigned i = hash_cell(cx, cy) & mask;
+    while (slots[i].bucket != -1) {
+        i = (i + 1) & mask;
+    }
+    slots[i].cx = cx;
+    slots[i].cy = cy;
+    slots[i].bucket = bucket;
+    nslots_used++;
+    return buckets[bucket];
+}
+
+// backward shift deletion for linear probing: pull every later entry of the
+// probe run that may live at `ix` into the hole.
+void SpatialHash::erase_slot(int ix) {
+    const unsigned mask = slots.size() - 1;
+    Bucket &b = buckets[slots[ix].bucket];
+    // actually release the memory, an empty cell should cost nothing.
+    std::vector<V2<int>>().swap(b.from);
+    std::vector<V2<int>>().swap(b.to);
+    std::vector<SegPointGuid>().swap(b.guids);
+    free_buckets.push_back(slots[ix].bucket);
+    nslots_used--;
+
+    unsigned hole = ix;
+    for (unsigned j = (hole + 1) & mask; slots[j].bucket != -1;
+         j = (j + 1) & mask) {
+        const unsigned home = hash_cell(slots[j].cx, slots[j].cy) & mask;
+        // can `j` move to `hole`? only if `home` is not cyclically in
+        // (hole, j].
+        const bool home_in_range = hole <= j ? (hole < home && home <= j)
+                                             : (hole < home || home <= j);
+        if (home_in_range) {
+            continue;
+        }
+        slots[hole] = slots[j];
+        hole = j;
+    }
+    slots[hole] = Slot();
+}
+
+void SpatialHash::insert(V2<int> a, V2<int> b, SegPointGuid v) {
+    for_cells(cell_sz, a, b, 0, [&](int cx, int cy) {
+        Bucket &bk = find_or_create_bucket(cx, cy);
+        bk.from.push_back(a);
+        bk.to.push_back(b);
+        bk.guids.push_back(v);
+        nentries++;
+    });
+}
+
+void SpatialHash::remove(V2<int> a, V2<int> b, SegPointGuid v) {
+    for_cells(cell_sz, a, b, 0, [&](int cx, int cy) {
+        const int ix = find_slot(cx, cy);
+        assert(ix != -1 && "removing piece from empty cell");
+        Bucket &bk = buckets[slots[ix].bucket];
+
+        int i = 0;
+        const int n = bk.guids.size();
+        while (i < n && !(bk.guids[i] == v)) {
+            i++;
+        }
+        assert(i < n && "removing piece not in spatial hash");
+
+        // order within a bucket is irrelevant: swap with the last entry.
+        bk.from[i] = bk.from.back();
+        bk.to[i] = bk.to.back();
+        bk.guids[i] = bk.guids.back();
+        bk.from.pop_back();
+        bk.to.pop_back();
+        bk.guids.pop_back();
+        nentries--;
+
+        if (bk.guids.empty()) {
+            erase_slot(ix);
+        }
+    });
+}
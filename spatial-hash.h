@@ -0,0 +1,301 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include "assert.h"
+#include "vector-graphics.h"
+
+// value stored into the spatial hash: the line piece from point
+// `point_guid` to point `point_guid + 1` of a segment.
+struct SegPointGuid {
+    int seg_guid;    // guid of segment.
+    int point_guid;  // guid of first point of the piece.
+
+    bool operator<(const SegPointGuid &other) const {
+        return seg_guid < other.seg_guid ||
+               (seg_guid == other.seg_guid && point_guid < other.point_guid);
+    }
+
+    bool operator==(const SegPointGuid &other) const {
+        return seg_guid == other.seg_guid && point_guid == other.point_guid;
+    }
+
+    SegPointGuid() : seg_guid(-1), point_guid(-1){};
+    SegPointGuid(int seg_guid, int point_guid)
+        : seg_guid(seg_guid), point_guid(point_guid){};
+};
+
+// floor division, so that cell -1 holds [-sz, 0) and cell 0 holds [0, sz).
+// plain `/` truncates towards zero and merges both into cell 0.
+inline int floor_div(int a, int b) {
+    assert(b > 0);
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// squared distance from p to the line piece [a, b].
+inline double dist_sq_point_piece(V2<int> p, V2<int> a, V2<int> b) {
+    const double abx = (double)b.x - a.x, aby = (double)b.y - a.y;
+    const double apx = (double)p.x - a.x, apy = (double)p.y - a.y;
+    const double len_sq = abx * abx + aby * aby;
+    double t = len_sq == 0 ? 0 : (apx * abx + apy * aby) / len_sq;
+    t = std::min<double>(1, std::max<double>(0, t));
+    const double dx = apx - t * abx, dy = apy - t * aby;
+    return dx * dx + dy * dy;
+}
+
+// squared distance between line pieces [a, b] and [c, d].
+inline double dist_sq_piece_piece(V2<int> a, V2<int> b, V2<int> c,
+                                  V2<int> d) {
+    // proper crossing: the pieces straddle each other.
+    auto orient = [](V2<int> p, V2<int> q, V2<int> r) {
+        const double v = ((double)q.x - p.x) * ((double)r.y - p.y) -
+                         ((double)q.y - p.y) * ((double)r.x - p.x);
+        return (v > 0) - (v < 0);
+    };
+    const int o1 = orient(a, b, c), o2 = orient(a, b, d);
+    const int o3 = orient(c, d, a), o4 = orient(c, d, b);
+    if (o1 * o2 < 0 && o3 * o4 < 0) {
+        return 0;
+    }
+    // otherwise the closest pair involves an endpoint.
+    return std::min(
+        std::min(dist_sq_point_piece(a, c, d), dist_sq_point_piece(b, c, d)),
+        std::min(dist_sq_point_piece(c, a, b), dist_sq_point_piece(d, a, b)));
+}
+
+// cell of a spatial hash, keyed by cell coordinates.
+struct Cell {
+    int cx = 0;
+    int cy = 0;
+    bool operator<(const Cell &o) const {
+        return cx < o.cx || (cx == o.cx && cy < o.cy);
+    }
+    bool operator==(const Cell &o) const { return cx == o.cx && cy == o.cy; }
+};
+
+inline unsigned hash_cell(int cx, int cy) {
+    // splitmix64 finalizer over both coordinates.
+    unsigned long long h =
+        ((unsigned long long)(unsigned)cx << 32) | (unsigned)cy;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return (unsigned)h;
+}
+
+// call f(cx, cy) for every cell of size `cell_sz` overlapping the box of
+// [a, b] grown by `pad`.
+template <typename F>
+void for_cells(int cell_sz, V2<int> a, V2<int> b, int pad, F f) {
+    const int cx0 = floor_div(std::min(a.x, b.x) - pad, cell_sz);
+    const int cx1 = floor_div(std::max(a.x, b.x) + pad, cell_sz);
+    const int cy0 = floor_div(std::min(a.y, b.y) - pad, cell_sz);
+    const int cy1 = floor_div(std::max(a.y, b.y) + pad, cell_sz);
+    for (int cx = cx0; cx <= cx1; ++cx) {
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            f(cx, cy);
+        }
+    }
+}
+
+// a swept eraser: the union of capsules [from[i], to[i]] of radius
+// radius[i].
+struct Sweep {
+    std::vector<V2<int>> from;
+    std::vector<V2<int>> to;
+    std::vector<int> radius;
+
+    bool empty() const { return from.empty(); }
+    void clear() {
+        from.clear();
+        to.clear();
+        radius.clear();
+    }
+    void add(V2<int> a, V2<int> b, int r) {
+        from.push_back(a);
+        to.push_back(b);
+        radius.push_back(r);
+    }
+
+    // does the piece [a, b] come within any capsule of the sweep?
+    bool hits(V2<int> a, V2<int> b) const {
+        for (int i = 0; i < (int)from.size(); ++i) {
+            const V2<int> c = from[i], d = to[i];
+            const int r = radius[i];
+            // cheap box rejection before the exact distance.
+            if (std::max(a.x, b.x) < std::min(c.x, d.x) - r ||
+                std::min(a.x, b.x) > std::max(c.x, d.x) + r ||
+                std::max(a.y, b.y) < std::min(c.y, d.y) - r ||
+                std::min(a.y, b.y) > std::max(c.y, d.y) + r) {
+                continue;
+            }
+            if (dist_sq_piece_piece(a, b, c, d) <= (double)r * r) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // every cell of size `cell_sz` under the sweep, sorted, each once.
+    void cells(int cell_sz, std::vector<Cell> &out) const {
+        out.clear();
+        for (int i = 0; i < (int)from.size(); ++i) {
+            for_cells(cell_sz, from[i], to[i], radius[i],
+                      [&](int cx, int cy) {
+                          out.push_back(Cell());
+                          out.back().cx = cx;
+                          out.back().cy = cy;
+                      });
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+};
+
+// Open addressing spatial hash of line pieces.
+// - the table is a flat array of (cell x, cell y, bucket index) slots, probed
+//   linearly. Deletion shifts entries back, so there are no tombstones.
+// - each cell owns a bucket of parallel arrays: the packed endpoints, and
+//   the ids. A query only streams over endpoints, and looks at an id only
+//   on a hit.
+// - a piece is stored in every cell its bounding box overlaps.
+// - a bucket that becomes empty is released, and its slot is freed.
+struct SpatialHash {
+    struct Bucket {
+        std::vector<V2<int>> from;
+        std::vector<V2<int>> to;
+        std::vector<SegPointGuid> guids;
+    };
+
+    explicit SpatialHash(int cell_sz) : cell_sz(cell_sz) {
+        assert(cell_sz > 0);
+    }
+
+    int cell_of(int coord) const { return floor_div(coord, cell_sz); }
+
+    void insert(V2<int> a, V2<int> b, SegPointGuid v);
+    // `v` must have been inserted as [a, b].
+    void remove(V2<int> a, V2<int> b, SegPointGuid v);
+
+    // number of (piece, cell) pairs stored.
+    int size() const { return nentries; }
+    // number of non-empty cells.
+    int ncells() const { return nslots_used; }
+
+    // call f(guid, from, to) for every stored piece that comes within the
+    // sweep. Every cell under the sweep is scanned exactly once, however
+    // many capsules overlap it. A piece that spans several cells may be
+    // reported once per cell. `f` may not insert or remove.
+    template <typename F>
+    void query_swept(const Sweep &sweep, F f) const {
+        sweep.cells(cell_sz, sweep_cells);
+        for (const Cell &c : sweep_cells) {
+            const int ix = find_slot(c.cx, c.cy);
+            if (ix == -1) {
+                continue;
+            }
+            const Bucket &bk = buckets[slots[ix].bucket];
+            const int n = bk.guids.size();
+            for (int i = 0; i < n; ++i) {
+                if (sweep.hits(bk.from[i], bk.to[i])) {
+                    f(bk.guids[i], bk.from[i], bk.to[i]);
+                }
+            }
+        }
+    }
+
+   private:
+    struct Slot {
+        int cx = 0;
+        int cy = 0;
+        int bucket = -1;  // -1 if the slot is empty.
+    };
+
+    // index of the slot holding (cx, cy), or -1.
+    int find_slot(int cx, int cy) const {
+        if (slots.empty()) {
+            return -1;
+        }
+        const unsigned mask = slots.size() - 1;
+        for (unsigned i = hash_cell(cx, cy) & mask;; i = (i + 1) & mask) {
+            const Slot &s = slots[i];
+            if (s.bucket == -1) {
+                return -1;
+            }
+            if (s.cx == cx && s.cy == cy) {
+                return i;
+            }
+        }
+    }
+
+    Bucket &find_or_create_bucket(int cx, int cy);
+    void erase_slot(int ix);
+    void grow();
+
+    int cell_sz;
+    std::vector<Slot> slots;  // size is zero or a power of two.
+    std::vector<Bucket> buckets;
+    std::vector<int> free_buckets;
+    int nslots_used = 0;
+    int nentries = 0;
+    mutable std::vector<Cell> sweep_cells;  // scratch for query_swept.
+};
+
+// A spatial hash frozen into flat arrays, as stored in a board file, and
+// queried in place. Slots are probed linearly like `SpatialHash`'s, and the
+// pieces of a cell are entries[begin, begin + count). Endpoints are not
+// stored: the caller looks them up.
+struct MappedSpatialHash {
+    struct Slot {
+        int cx;
+        int cy;
+        int begin;
+        int count;  // 0 if the slot is empty.
+    };
+
+    int cell_sz = 1;
+    const Slot *slots = nullptr;
+    unsigned nslots = 0;  // zero or a power of two.
+    const SegPointGuid *entries = nullptr;
+
+    // call f(guid, from, to) for every piece that comes within the sweep,
+    // where endpoints(guid, from, to) fetches the endpoints of a piece.
+    template <typename E, typename F>
+    void query_swept(const Sweep &sweep, E endpoints, F f) const {
+        if (nslots == 0) {
+            return;
+        }
+        sweep.cells(cell_sz, sweep_cells);
+        for (const Cell &c : sweep_cells) {
+            const Slot *s = find_slot(c.cx, c.cy);
+            if (!s) {
+                continue;
+            }
+            for (int i = s->begin; i < s->begin + s->count; ++i) {
+                V2<int> from, to;
+                endpoints(entries[i], from, to);
+                if (sweep.hits(from, to)) {
+                    f(entries[i], from, to);
+                }
+            }
+        }
+    }
+
+   private:
+    const Slot *find_slot(int cx, int cy) const {
+        const unsigned mask = nslots - 1;
+        for (unsigned i = hash_cell(cx, cy) & mask;; i = (i + 1) & mask) {
+            const Slot &s = slots[i];
+            if (s.count == 0) {
+                return nullptr;
+            }
+            if (s.cx == cx && s.cy == cy) {
+                return &s;
+            }
+        }
+    }
+
+    mutable std::vector<Cell> sweep_cells;  // scratch for query_swept.
+};
@@ -0,0 +1,189 @@
+#include "stream.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "assert.h"
+
+RegionStreamer::~RegionStreamer() { stop(); }
+
+void RegionStreamer::start(const MappedBoard &board, size_t budget_bytes) {
+    assert(!loader.joinable() && "streamer already started");
+    const BoardHeader &h = *board.header;
+    budget = budget_bytes;
+    regions.resize(h.nregions);
+    resident_flags.reset(new std::atomic<bool>[h.nregions]);
+    for (uint64_t i = 0; i < h.nregions; ++i) {
+        const BoardRegion &b = board.regions[i];
+        Region &r = regions[i];
+        r.bounds = box_from_board(b.bounds);
+        r.begin[0] = (char *)(board.points + b.first_point);
+        r.end[0] = (char *)(board.points + b.end_point);
+        r.begin[1] = (char *)(board.created + b.first_point);
+        r.end[1] = (char *)(board.created + b.end_point);
+        r.begin[2] = (char *)(board.erased + b.first_point);
+        r.end[2] = (char *)(board.erased + b.end_point);
+        r.begin[3] = (char *)(board.handles + 2 * b.first_point);
+        r.end[3] = (char *)(board.handles + 2 * b.end_point);
+        r.bytes = (b.end_point - b.first_point) * (3 * sizeof(V2<int>) + 8);
+        resident_flags[i].store(false);
+    }
+    stopping = false;
+    loader = std::thread(&RegionStreamer::loader_loop, this);
+}
+
+void RegionStreamer::stop() {
+    if (!loader.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        stopping = true;
+        wake.notify_one();
+    }
+    loader.join();
+}
+
+void RegionStreamer::want(const Box &box) {
+    std::lock_guard<std::mutex> lock(mu);
+    if (box == wanted) {
+        return;
+    }
+    wanted = box;
+    wanted_tick++;
+    wake.notify_one();
+}
+
+void RegionStreamer::prefetch(const Box &box) {
+    static const long page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < (int)regions.size(); ++i) {
+        const Region &r = regions[i];
+        if (resident(i) || !r.bounds.intersects(box)) {
+            continue;
+        }
+        for (int b = 0; b < 4; ++b) {
+            if (r.begin[b] == r.end[b]) {
+                continue;
+            }
+            char *lo =
+                (char *)((uintptr_t)r.begin[b] & ~(uintptr_t)(page - 1));
+            madvise(lo, r.end[b] - lo, MADV_WILLNEED);
+        }
+    }
+}
+
+void RegionStreamer::load(Region &r) {
+    static const long page = sysconf(_SC_PAGESIZE);
+    for (int b = 0; b < 4; ++b) {
+        if (r.begin[b] == r.end[b]) {
+            continue;
+        }
+        char *lo = (char *)((uintptr_t)r.begin[b] & ~(uintptr_t)(page - 1));
+        madvise(lo, r.end[b] - lo, MADV_WILLNEED);
+        // readahead is only a hint: touch every page, so that the render
+        // thread never faults.
+        for (volatile char *p = lo; p < r.end[b]; p += page) {
+            (void)*p;
+        }
+    }
+}
+
+void RegionStreamer::evict(Region &r) {
+    static const long page = sysconf(_SC_PAGESIZE);
+    for (int b = 0; b < 4; ++b) {
+        // whole pages only: the pages at the edges are shared with the
+        // neighbouring regions.
+        char *lo = (char *)(((uintptr_t)r.begin[b] + page - 1) &
+                            ~(uintptr_t)(page - 1));
+        char *hi = (char *)((uintptr_t)r.end[b] & ~(uintptr_t)(page - 1));
+        if (lo >= hi) {
+            continue;
+        }
+        if (b == 0 || b == 3) {
+            madvise(lo, hi - lo, MADV_DONTNEED);
+        } else {
+            // MADV_DONTNEED would drop the erasures in epoch pages. Without
+            // MADV_PAGEOUT (Linux 5.4) they stay in memory.
+#ifdef MADV_PAGEOUT
+            madvise(lo, hi - lo, MADV_PAGEOUT);
+#endif
+        }
+    }
+}
+
+void RegionStreamer::loader_loop() {
+    long seen_tick = 0;
+    std::vector<int> hot;
+    for (;;) {
+        Box box;
+        long tick;
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            wake.wait(lock,
+                      [&] { return stopping || wanted_tick != seen_tick; });
+            if (stopping) {
+                return;
+            }
+            box = wanted;
+            tick = seen_tick = wanted_tick;
+        }
+
+        // nearest regions first: they are the ones on screen.
+        hot.clear();
+        for (int i = 0; i < (int)regions.size(); ++i) {
+            if (regions[i].bounds.intersects(box)) {
+                regions[i].last_wanted = tick;
+                hot.push_back(i);
+            }
+        }
+        const long cx = ((long)box.lo.x + box.hi.x) / 2;
+        const long cy = ((long)box.lo.y + box.hi.y) / 2;
+        auto dist = [&](int i) {
+            const Box &b = regions[i].bounds;
+            return std::abs(((long)b.lo.x + b.hi.x) / 2 - cx) +
+                   std::abs(((long)b.lo.y + b.hi.y) / 2 - cy);
+        };
+        std::sort(hot.begin(), hot.end(),
+                  [&](int a, int b) { return dist(a) < dist(b); });
+
+        for (int i : hot) {
+            if (resident(i)) {
+                continue;
+            }
+            Region &r = regions[i];
+            // make room, coldest first. wanted regions are never evicted.
+            while (resident_bytes + r.bytes > budget) {
+                int victim = -1;
+                for (int j = 0; j < (int)regions.size(); ++j) {
+                    if (resident(j) && regions[j].last_wanted != tick &&
+                        (victim == -1 || regions[j].last_wanted <
+                                             regions[victim].last_wanted)) {
+                        victim = j;
+                    }
+                }
+                if (victim == -1) {
+                    break;
+                }
+                resident_flags[victim].store(false, std::memory_order_release);
+                evict(regions[victim]);
+                resident_bytes -= regions[victim].bytes;
+            }
+            // more is wanted than fits: the farthest regions stay out.
+            if (resident_bytes + r.bytes > budget) {
+                break;
+            }
+            load(r);
+            resident_bytes += r.bytes;
+            resident_flags[i].store(true, std::memory_order_release);
+            nloads.fetch_add(1, std::memory_order_release);
+
+            // the viewport moved on: start over from the new one.
+            std::lock_guard<std::mutex> lock(mu);
+            if (stopping || wanted_tick != tick) {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "quadtree.h"
+
+// Keeps the regions of a mapped board that are near the viewport in
+// memory, and lets the others go.
+// Every frame the render thread says which part of the board it wants. A
+// loader thread faults the points and epochs of those regions in, nearest
+// first, and only then marks them resident. The render thread draws
+// resident regions only, so it never waits on the disk: a region that
+// scrolls into view shows up a frame or two later.
+// Once resident regions pass the budget, the ones not wanted for longest
+// are given back to the kernel. Points and handles are never written, so
+// their pages are simply dropped. Epoch pages may hold erasures (the mapping is
+// private), so they are only paged out, which keeps their contents.
+// The eraser and the chunk refresh after it read the regions under the
+// eraser whether they are resident or not. `prefetch` starts reading
+// those regions in as soon as the eraser moves. A region the disk has not
+// delivered by the end of the frame still stalls that frame.
+struct RegionStreamer {
+    ~RegionStreamer();
+
+    // starts the loader thread. `board` must stay mapped until stop().
+    void start(const MappedBoard &board, size_t budget_bytes);
+    void stop();
+    bool started() const { return resident_flags != nullptr; }
+
+    bool resident(int region) const {
+        return resident_flags[region].load(std::memory_order_acquire);
+    }
+
+    // regions intersecting `box` are wanted, everything else is not.
+    void want(const Box &box);
+    // start reading in the regions intersecting `box` that are not
+    // resident, without waiting. They are not marked resident.
+    void prefetch(const Box &box);
+
+    // bumped every time a region becomes resident, so that whatever was
+    // drawn without it can be drawn again.
+    long loads() const { return nloads.load(std::memory_order_acquire); }
+
+   private:
+    struct Region {
+        Box bounds;
+        // [begin, end) byte ranges of the region in the points, created,
+        // erased and handles blocks.
+        char *begin[4];
+        char *end[4];
+        size_t bytes;
+        long last_wanted = -1;
+    };
+
+    void loader_loop();
+    void load(Region &r);
+    void evict(Region &r);
+
+    std::vector<Region> regions;
+    std::unique_ptr<std::atomic<bool>[]> resident_flags;
+    std::atomic<long> nloads{0};
+    size_t budget = 0;
+    size_t resident_bytes = 0;  // loader thread only.
+
+    std::mutex mu;
+    std::condition_variable wake;
+    Box wanted;
+    long wanted_tick = 0;  // bumped by every want().
+    bool stopping = false;
+    std::thread loader;
+};
@@ -0,0 +1,108 @@
+#include "stroke-filter.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "assert.h"
+#include "spatial-hash.h"
+
+static bool same_point(V2<int> a, V2<int> b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+void StrokeFilter::begin() {
+    has_taken = has_skipped = false;
+    window.clear();
+    window_first = next = 0;
+    has_anchor = false;
+    run.clear();
+}
+
+void StrokeFilter::add(V2<int> p, uint32_t ms, std::vector<V2<int>> &out) {
+    if (has_taken) {
+        const int d = (p - taken).lensq();
+        if (d < MIN_STEP * MIN_STEP ||
+            (ms - taken_ms < RESAMPLE_MS && d < MAX_STEP * MAX_STEP)) {
+            skipped = p;
+            has_skipped = true;
+            return;
+        }
+    }
+    taken = p;
+    taken_ms = ms;
+    has_taken = true;
+    has_skipped = false;
+    window.push_back(p);
+    smooth(false, out);
+}
+
+void StrokeFilter::finish(std::vector<V2<int>> &out) {
+    // the stroke ends where the pen lifted, even if it barely moved.
+    if (has_skipped && !same_point(skipped, taken)) {
+        window.push_back(skipped);
+    }
+    has_skipped = false;
+    smooth(true, out);
+    if (!run.empty()) {
+        out.push_back(run.back());
+        run.clear();
+    }
+}
+
+void StrokeFilter::held_back(std::vector<V2<int>> &out) const {
+    out.insert(out.end(), run.begin(), run.end());
+    for (int i = next; i < window_first + (int)window.size(); ++i) {
+        out.push_back(window[i - window_first]);
+    }
+    if (has_skipped) {
+        out.push_back(skipped);
+    }
+}
+
+void StrokeFilter::smooth(bool all, std::vector<V2<int>> &out) {
+    const int end = window_first + window.size();
+    for (; next < end; ++next) {
+        // symmetric around `next`, so a straight stroke stays straight.
+        int r = next < SMOOTH_RADIUS ? next : SMOOTH_RADIUS;
+        if (all) {
+            r = std::min(r, end - 1 - next);
+        } else if (next + SMOOTH_RADIUS >= end) {
+            break;
+        }
+        V2<float> sum;
+        for (int i = next - r; i <= next + r; ++i) {
+            sum = sum + window[i - window_first].cast<float>();
+        }
+        sum = sum / (2 * r + 1);
+        simplify(V2<int>(lroundf(sum.x), lroundf(sum.y)), out);
+    }
+    // keep the samples the next one is averaged with.
+    while (window_first < next - SMOOTH_RADIUS) {
+        window.pop_front();
+        window_first++;
+    }
+}
+
+void StrokeFilter::simplify(V2<int> p, std::vector<V2<int>> &out) {
+    if (!has_anchor) {
+        anchor = p;
+        has_anchor = true;
+        out.push_back(p);
+        return;
+    }
+    if (same_point(p, run.empty() ? anchor : run.back())) {
+        return;
+    }
+    bool straight = (int)run.size() < MAX_RUN;
+    for (int i = 0; straight && i < (int)run.size(); ++i) {
+        straight = dist_sq_point_piece(run[i], anchor, p) <=
+                   COLLINEAR_TOL * COLLINEAR_TOL;
+    }
+    if (!straight) {
+        anchor = run.back();
+        out.push_back(anchor);
+        run.clear();
+    }
+    run.push_back(p);
+}
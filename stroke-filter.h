@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+#include "vector-graphics.h"
+
+// Turns the raw tablet samples of a stroke into the points that are kept.
+// Tablets report a sample every few milliseconds whether or not the pen
+// moved, so a slow stroke is mostly duplicates and near-duplicates. The
+// filter runs three stages, each with a bounded lookahead, so a point is
+// kept at most a handful of samples after the pen was there:
+// - resampling: a sample is dropped if it is closer than MIN_STEP to the
+//   last one taken, or if it comes within RESAMPLE_MS of it without having
+//   moved MAX_STEP.
+// - smoothing: each sample is replaced by the average of the SMOOTH_RADIUS
+//   samples before and after it. The window shrinks at the ends of the
+//   stroke, so the stroke starts and ends where the pen did.
+// - simplification: a point is dropped if the line from the previous kept
+//   point to the next one passes within COLLINEAR_TOL of it, and of every
+//   other point dropped since. At most MAX_RUN points are folded into one
+//   line.
+struct StrokeFilter {
+    static const int MIN_STEP = 1;
+    static const int MAX_STEP = 4;
+    static const int RESAMPLE_MS = 8;
+    static const int SMOOTH_RADIUS = 2;
+    static constexpr float COLLINEAR_TOL = 0.5;
+    static const int MAX_RUN = 8;
+
+    // start a new stroke.
+    void begin();
+    // add the sample `p`, taken at `ms` milliseconds; the points this
+    // settles are appended to `out`.
+    void add(V2<int> p, uint32_t ms, std::vector<V2<int>> &out);
+    // the pen lifted: append every point still held back to `out`.
+    void finish(std::vector<V2<int>> &out);
+    // append the samples of the stroke that have not been settled yet to
+    // `out`, roughly: a point still held back by the simplification is
+    // given as it is, a sample not yet smoothed as it was taken.
+    void held_back(std::vector<V2<int>> &out) const;
+
+   private:
+    void smooth(bool all, std::vector<V2<int>> &out);
+    void simplify(V2<int> p, std::vector<V2<int>> &out);
+
+    // resampling: the last sample taken, and the last one seen.
+    bool has_taken = false;
+    V2<int> taken;
+    uint32_t taken_ms = 0;
+    bool has_skipped = false;
+    V2<int> skipped;
+
+    // smoothing: samples [window_first, window_first + window.size()) of
+    // the stroke, and the index of the next one to smooth.
+    std::deque<V2<int>> window;
+    int window_first = 0;
+    int next = 0;
+
+    // simplification: the last point kept, and the points after it that
+    // may still be dropped.
+    bool has_anchor = false;
+    V2<int> anchor;
+    std::vector<V2<int>> run;
+};
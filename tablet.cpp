@@ -0,0 +1,182 @@
+#include "tablet.h"
+
+#include <X11/extensions/XInput2.h>
+#include <math.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "assert.h"
+#include "easytab.h"
+
+// the same devices EasyTab picks.
+static bool is_tablet(const char *name) {
+    return strstr(name, "stylus") || strstr(name, "STYLUS") ||
+           strstr(name, "Wacom") || strstr(name, "ERASER") ||
+           strstr(name, "eraser");
+}
+
+bool XI2Tablet::open(Display *display, Window window) {
+    assert(!is_open() && "tablet already open");
+    int event, error;
+    if (!XQueryExtension(display, "XInputExtension", &opcode, &event,
+                         &error)) {
+        return false;
+    }
+    int major = 2, minor = 2;
+    if (XIQueryVersion(display, &major, &minor) != Success) {
+        std::cerr << "tablet: no XInput 2.2, server has " << major << "."
+                  << minor << "\n";
+        return false;
+    }
+    this->display = display;
+
+    const Atom pressure_label = XInternAtom(display, "Abs Pressure", True);
+    int ndevices = 0;
+    XIDeviceInfo *infos = XIQueryDevice(display, XIAllDevices, &ndevices);
+    for (int i = 0; i < ndevices; ++i) {
+        const XIDeviceInfo &info = infos[i];
+        if ((info.use != XISlavePointer && info.use != XIFloatingSlave) ||
+            !is_tablet(info.name)) {
+            continue;
+        }
+        Device d;
+        d.id = info.deviceid;
+        d.pressure_valuator = -1;
+        d.pressure_min = 0;
+        d.pressure_max = 1;
+        for (int c = 0; c < info.num_classes; ++c) {
+            if (info.classes[c]->type != XIValuatorClass) {
+                continue;
+            }
+            const XIValuatorClassInfo *v =
+                (const XIValuatorClassInfo *)info.classes[c];
+            // drivers that do not label their axes put pressure third.
+            if ((pressure_label != None && v->label == pressure_label) ||
+                (d.pressure_valuator == -1 && v->number == 2)) {
+                d.pressure_valuator = v->number;
+                d.pressure_min = v->min;
+                d.pressure_max = v->max > v->min ? v->max : v->min + 1;
+            }
+        }
+        std::cerr << "tablet: using " << info.name << " (XInput2 device "
+                  << d.id << ")\n";
+        devices.push_back(d);
+    }
+    XIFreeDeviceInfo(infos);
+    if (devices.empty()) {
+        return false;
+    }
+
+    unsigned char motion[XIMaskLen(XI_LASTEVENT)] = {0};
+    XISetMask(motion, XI_Motion);
+    XISetMask(motion, XI_ButtonPress);
+    XISetMask(motion, XI_ButtonRelease);
+    // raw events are only delivered to the root window.
+    unsigned char raw[XIMaskLen(XI_LASTEVENT)] = {0};
+    XISetMask(raw, XI_RawMotion);
+    for (const Device &d : devices) {
+        XIEventMask mask;
+        mask.deviceid = d.id;
+        mask.mask_len = sizeof(motion);
+        mask.mask = motion;
+        XISelectEvents(display, window, &mask, 1);
+        mask.mask_len = sizeof(raw);
+        mask.mask = raw;
+        XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+    }
+    XFlush(display);
+    return true;
+}
+
+const XI2Tablet::Device *XI2Tablet::find(int id) const {
+    for (const Device &d : devices) {
+        if (d.id == id) {
+            return &d;
+        }
+    }
+    return nullptr;
+}
+
+void XI2Tablet::handle(XEvent *event) {
+    XGenericEventCookie *cookie = &event->xcookie;
+    if (!is_open() || cookie->type != GenericEvent ||
+        cookie->extension != opcode || !cookie->data) {
+        return;
+    }
+
+    if (cookie->evtype == XI_RawMotion) {
+        const XIRawEvent *raw = (const XIRawEvent *)cookie->data;
+        if (find(raw->deviceid) && (last.buttons & EasyTab_Buttons_Pen_Touch)) {
+            raw_since_motion++;
+            nraw++;
+        }
+        return;
+    }
+    if (cookie->evtype != XI_Motion && cookie->evtype != XI_ButtonPress &&
+        cookie->evtype != XI_ButtonRelease) {
+        return;
+    }
+    const XIDeviceEvent *e = (const XIDeviceEvent *)cookie->data;
+    const Device *d = find(e->sourceid);
+    if (!d) {
+        d = find(e->deviceid);
+    }
+    if (!d) {
+        return;
+    }
+
+    PenSample s = last;
+    s.x = lround(e->event_x);
+    s.y = lround(e->event_y);
+    s.ms = e->time;
+    // valuators only hold the axes that changed, in axis order.
+    if (d->pressure_valuator >= 0 &&
+        d->pressure_valuator < e->valuators.mask_len * 8 &&
+        XIMaskIsSet(e->valuators.mask, d->pressure_valuator)) {
+        int ix = 0;
+        for (int i = 0; i < d->pressure_valuator; ++i) {
+            ix += XIMaskIsSet(e->valuators.mask, i) ? 1 : 0;
+        }
+        s.pressure = (e->valuators.values[ix] - d->pressure_min) /
+                     (d->pressure_max - d->pressure_min);
+    }
+    // like EasyTab: the pen touches when it presses.
+    if (s.pressure > 0) {
+        s.buttons |= EasyTab_Buttons_Pen_Touch;
+    } else {
+        s.buttons &= ~EasyTab_Buttons_Pen_Touch;
+    }
+
+    const bool was_down = last.buttons & EasyTab_Buttons_Pen_Touch;
+    if (was_down) {
+        nsamples++;
+        if (raw_since_motion > 1) {
+            ncoalesced += raw_since_motion - 1;
+            if (s.ms - last.ms > GAP_MS) {
+                ngaps++;
+            }
+        }
+        if (!(s.buttons & EasyTab_Buttons_Pen_Touch)) {
+            end_stroke();
+        }
+    }
+    raw_since_motion = 0;
+    batch.push_back(s);
+    last = s;
+}
+
+void XI2Tablet::end_stroke() {
+    if (ncoalesced > 0 || ngaps > 0) {
+        std::cerr << "tablet: stroke of " << nsamples << " samples: " << nraw
+                  << " raw samples, " << ncoalesced
+                  << " coalesced away, " << ngaps << " gaps over " << GAP_MS
+                  << "ms\n";
+    }
+    nsamples = nraw = ncoalesced = ngaps = 0;
+}
+
+void XI2Tablet::take(std::vector<PenSample> &out) {
+    out.insert(out.end(), batch.begin(), batch.end());
+    batch.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <X11/Xlib.h>
+#include <stdint.h>
+
+#include <vector>
+
+// one sample of the pen, in window coordinates.
+struct PenSample {
+    int x = 0;
+    int y = 0;
+    float pressure = 0;  // 0 to 1.
+    int buttons = 0;     // EasyTab_Buttons_ bits.
+    uint32_t ms = 0;     // when the tablet took it.
+};
+
+// Tablet input through XInput2.
+// EasyTab goes through XInput1, one event at a time. Here the stylus and
+// eraser devices are selected for XI_Motion on the window, with the pressure
+// valuator and the server timestamp of every sample read straight from the
+// event. Samples are batched as X events arrive, and handle_packet drains
+// the whole batch once per frame.
+// The tablet is also selected for XI_RawMotion, which reports every
+// hardware sample. Comparing the two streams tells the samples coalesced
+// on the way to the window apart from gaps where the pen sent nothing.
+// Each stroke's counts are logged when the pen lifts.
+struct XI2Tablet {
+    // a motion event this long after the previous one is a gap, if the
+    // tablet sent raw samples in between.
+    static const uint32_t GAP_MS = 20;
+
+    // false if the server has no XInput 2.2, or there is no tablet.
+    bool open(Display *display, Window window);
+    bool is_open() const { return !devices.empty(); }
+
+    // look at an X event. Generic event data must still be attached, so
+    // call this from an SDL event watch, not after SDL_PollEvent.
+    void handle(XEvent *event);
+
+    // move the samples gathered since the last call to `out`.
+    void take(std::vector<PenSample> &out);
+
+   private:
+    struct Device {
+        int id;
+        int pressure_valuator;  // -1 if there is none.
+        double pressure_min, pressure_max;
+    };
+
+    const Device *find(int id) const;
+    void end_stroke();
+
+    Display *display = nullptr;
+    int opcode = -1;
+    std::vector<Device> devices;
+    std::vector<PenSample> batch;
+    PenSample last;
+
+    // per stroke: motion events, raw samples, raw samples that never
+    // reached the window, and gaps.
+    int raw_since_motion = 0;
+    long nsamples = 0, nraw = 0, ncoalesced = 0, ngaps = 0;
+};
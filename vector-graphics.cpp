@@ -4,7 +4,11 @@
 #include <cairo/cairo-gl.h>
 #include <cairo/cairo.h>
 
+#include <string.h>
+
+#include <algorithm>
 #include <iostream>
+#include <utility>
 
 #include "assert.h"
 
@@ -14,12 +18,94 @@
 #define NANOVG_GL2_IMPLEMENTATION
 #include "nanovg/nanovg.h"
 #include "nanovg/nanovg_gl.h"
+// GLEW provides framebuffer objects on GL2 as well.
+#define NANOVG_FBO_VALID 1
+#include "nanovg/nanovg_gl_utils.h"
 
 NVGcontext *g_vg = NULL;
+// VGFlags given to vg_init.
+static int g_vg_flags = 0;
+
+// With msaa, frames and layer updates draw into this multisampled
+// framebuffer, and what they drew is resolved into the window or layer when
+// they end. It is as big as the biggest of those.
+static int g_msaa_samples = 0;
+static GLuint g_msaa_fbo = 0;
+static GLuint g_msaa_rbo[2] = {0, 0};  // color, and depth and stencil.
+static int g_msaa_w = 0, g_msaa_h = 0;
+
+static void delete_msaa() {
+    glDeleteFramebuffers(1, &g_msaa_fbo);
+    glDeleteRenderbuffers(2, g_msaa_rbo);
+    g_msaa_fbo = g_msaa_rbo[0] = g_msaa_rbo[1] = 0;
+    g_msaa_w = g_msaa_h = 0;
+}
+
+// make the multisampled framebuffer at least w x h. false if the driver
+// will not have it.
+static bool msaa_fit(int w, int h) {
+    if (g_msaa_fbo && w <= g_msaa_w && h <= g_msaa_h) {
+        return true;
+    }
+    w = std::max(w, g_msaa_w);
+    h = std::max(h, g_msaa_h);
+    delete_msaa();
+    glGenFramebuffers(1, &g_msaa_fbo);
+    glGenRenderbuffers(2, g_msaa_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_msaa_rbo[0]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, g_msaa_samples, GL_RGBA8,
+                                     w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_msaa_rbo[1]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, g_msaa_samples,
+                                     GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint bound;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_msaa_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, g_msaa_rbo[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, g_msaa_rbo[1]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+                              GL_RENDERBUFFER, g_msaa_rbo[1]);
+    const bool ok =
+        glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (ok) {
+        // nanovg expects a clear stencil, and leaves it clear.
+        glClear(GL_STENCIL_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, bound);
+    if (!ok) {
+        delete_msaa();
+        return false;
+    }
+    g_msaa_w = w;
+    g_msaa_h = h;
+    return true;
+}
 
-void vg_init(SDL_GLContext gl_context) {
+void vg_init(SDL_GLContext gl_context, int flags, int msaa_samples) {
     if (g_vg) { nvgDeleteGL2(g_vg); }
-    g_vg = nvgCreateGL2(NVG_ANTIALIAS | NVG_STENCIL_STROKES | NVG_DEBUG);
+    g_vg_flags = flags;
+    g_msaa_samples = 0;
+    if (msaa_samples > 0) {
+        GLint max_samples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+        g_msaa_samples = std::min<int>(msaa_samples, max_samples);
+        if (g_msaa_samples <= 0 || !msaa_fit(1, 1)) {
+            std::cerr << "vg: no multisampled framebuffers, antialiasing "
+                         "with nanovg\n";
+            g_msaa_samples = 0;
+        }
+    }
+    // strokes are opaque and differ only in color: batched, the visible
+    // runs of a whole frame go out in a few draws, in the order drawn.
+    // Multisampled, nanovg need not add fringes to antialias edges.
+    g_vg = nvgCreateGL2((g_msaa_samples ? 0 : NVG_ANTIALIAS) |
+                        NVG_STENCIL_STROKES | NVG_BATCH_STROKES |
+                        (flags & VG_DEPTH_STROKES ? NVG_DEPTH_STROKES : 0) |
+                        NVG_DEBUG);
     nvgLineCap(g_vg, NVG_ROUND);
     nvgLineJoin(g_vg, NVG_ROUND);
 }
@@ -51,33 +137,210 @@ void vg_draw_circle(int x, int y, int r, Color c) {
     nvgFill(g_vg);
 }
 
-void vg_draw_lines(const std::vector<V2<int>> &vs,
-                   const std::vector<bool> &visible, int radius, Color c,
-                   V2<int> offset, float zoom) {
-    assert(vs.size() == visible.size());
-    // TODO: use `visible`vs!
+void vg_draw_curves(const V2<int> *vs, const V2<int> *hs, int n, int radius,
+                    Color c, V2<int> offset, float zoom) {
+    if (n < 2) {
+        return;
+    }
     nvgStrokeColor(g_vg, nvgRGBA(c.r, c.g, c.b, 255));
     nvgStrokeWidth(g_vg, radius);
 
-    int l = 0;
-    while (l + 1 < vs.size()) {
-        if (!(visible[l] && visible[l + 1])) {
-            l++;
-            continue;
+    auto x = [&](V2<int> p) { return zoom * (p.x - offset.x); };
+    auto y = [&](V2<int> p) { return zoom * (p.y - offset.y); };
+    nvgBeginPath(g_vg);
+    nvgMoveTo(g_vg, x(vs[0]), y(vs[0]));
+    for (int i = 1; i < n; ++i) {
+        const V2<int> h1 = hs[2 * (i - 1)], h2 = hs[2 * (i - 1) + 1];
+        // handles on the knots: a straight piece, no need to flatten.
+        if (h1.x == vs[i - 1].x && h1.y == vs[i - 1].y && h2.x == vs[i].x &&
+            h2.y == vs[i].y) {
+            nvgLineTo(g_vg, x(vs[i]), y(vs[i]));
+        } else {
+            nvgBezierTo(g_vg, x(h1), y(h1), x(h2), y(h2), x(vs[i]), y(vs[i]));
         }
-        nvgBeginPath(g_vg);
-        nvgMoveTo(g_vg, zoom * (vs[l].x - offset.x),
-                  zoom * (vs[l].y - offset.y));
-        int r = l + 1;
-        for (; r < vs.size() && visible[r]; ++r) {
-            nvgLineTo(g_vg, zoom * (vs[r].x - offset.x),
-                      zoom * (vs[r].y - offset.y));
+    }
+    nvgStroke(g_vg);
+}
+
+int vg_create_image(int w, int h, const unsigned char *rgba) {
+    const int image = nvgCreateImageRGBA(g_vg, w, h, 0, rgba);
+    assert(image != 0 && "unable to create image");
+    return image;
+}
+
+void vg_update_image(int image, const unsigned char *rgba) {
+    nvgUpdateImage(g_vg, image, rgba);
+}
+
+void vg_update_image_region(int image, int x, int y, int w, int h,
+                            const unsigned char *rgba) {
+    nvgUpdateImageRegion(g_vg, image, x, y, w, h, rgba);
+}
+
+void vg_delete_image(int image) { nvgDeleteImage(g_vg, image); }
+
+void vg_draw_image(int image, float x, float y, float w, float h) {
+    nvgBeginPath(g_vg);
+    nvgRect(g_vg, x, y, w, h);
+    nvgFillPaint(g_vg, nvgImagePattern(g_vg, x, y, w, h, 0, image, 1));
+    nvgFill(g_vg);
+}
+
+// size of what the current frame draws into. Its height is for GL's
+// bottom-up rects.
+static int g_target_w = 0, g_target_h = 0;
+// with msaa, the framebuffer the current frame is resolved into.
+static GLint g_resolve_fbo = 0;
+
+// start a frame into the bound framebuffer, of w x h. With msaa it draws
+// into the multisampled framebuffer instead.
+static void begin_target(int w, int h) {
+    g_target_w = w;
+    g_target_h = h;
+    if (!g_msaa_samples) {
+        return;
+    }
+    const bool ok = msaa_fit(w, h);
+    assert(ok && "unable to grow the multisampled framebuffer");
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &g_resolve_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_msaa_fbo);
+}
+
+// with msaa, resolve what the frame drew into the framebuffer it was
+// started in. The blit is scissored too, so only the clip is resolved.
+static void end_target() {
+    if (!g_msaa_samples) {
+        return;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_msaa_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_resolve_fbo);
+    glBlitFramebuffer(0, 0, g_target_w, g_target_h, 0, 0, g_target_w,
+                      g_target_h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_resolve_fbo);
+}
+
+void vg_clip(int x, int y, int w, int h) {
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, g_target_h - y - h, w, h);
+}
+
+static void end_clip() { glDisable(GL_SCISSOR_TEST); }
+
+#ifndef GLX_BACK_BUFFER_AGE_EXT
+#define GLX_BACK_BUFFER_AGE_EXT 0x20F4
+#endif
+
+int vg_back_buffer_age() {
+    Display *display = glXGetCurrentDisplay();
+    const GLXDrawable drawable = glXGetCurrentDrawable();
+    if (!display || !drawable) {
+        return 0;
+    }
+    static int has_age = -1;
+    if (has_age == -1) {
+        const char *exts =
+            glXQueryExtensionsString(display, DefaultScreen(display));
+        has_age = exts && strstr(exts, "GLX_EXT_buffer_age");
+        if (!has_age) {
+            std::cerr << "vg: no GLX_EXT_buffer_age, every frame is drawn "
+                         "in full\n";
+        }
+    }
+    if (!has_age) {
+        return 0;
+    }
+    unsigned int age = 0;
+    glXQueryDrawable(display, drawable, GLX_BACK_BUFFER_AGE_EXT, &age);
+    return age;
+}
+
+// the layer, and a second framebuffer to scroll it into.
+static NVGLUframebuffer *g_layer[2] = {NULL, NULL};
+static int g_layer_w = 0, g_layer_h = 0;
+
+static void delete_layer() {
+    for (NVGLUframebuffer *&fb : g_layer) {
+        nvgluDeleteFramebuffer(fb);
+        fb = NULL;
+    }
+    g_layer_w = g_layer_h = 0;
+}
+
+bool vg_layer_resize(int w, int h) {
+    if (g_layer[0] && g_layer_w == w && g_layer_h == h) {
+        return true;
+    }
+    delete_layer();
+    for (NVGLUframebuffer *&fb : g_layer) {
+        fb = nvgluCreateFramebuffer(
+            g_vg, w, h,
+            g_vg_flags & VG_DEPTH_STROKES ? NVG_IMAGE_FRAMEBUFFER_DEPTH : 0);
+        if (!fb) {
+            delete_layer();
+            return false;
         }
-        nvgStrokeColor(g_vg, nvgRGBA(c.r, c.g, c.b, 255));
-        nvgStroke(g_vg);
-        l = r;
     }
+    g_layer_w = w;
+    g_layer_h = h;
+    return true;
 }
 
-void vg_begin_frame(int w, int h) { nvgBeginFrame(g_vg, w, h, (float)w/h); };
-void vg_end_frame() { nvgEndFrame(g_vg); };
+// start a frame that draws into `fb`.
+static void begin_layer_frame(NVGLUframebuffer *fb) {
+    nvgluBindFramebuffer(fb);
+    glViewport(0, 0, g_layer_w, g_layer_h);
+    begin_target(g_layer_w, g_layer_h);
+    // nanovg expects a clear stencil at the start of a frame.
+    glClear(GL_STENCIL_BUFFER_BIT);
+    nvgBeginFrame(g_vg, g_layer_w, g_layer_h, 1);
+}
+
+static void end_layer_frame() {
+    nvgEndFrame(g_vg);
+    end_target();
+    end_clip();
+    nvgluBindFramebuffer(NULL);
+}
+
+static void fill_with_layer(NVGLUframebuffer *fb, float x, float y) {
+    nvgBeginPath(g_vg);
+    nvgRect(g_vg, 0, 0, g_layer_w, g_layer_h);
+    nvgFillPaint(g_vg, nvgImagePattern(g_vg, x, y, g_layer_w, g_layer_h, 0,
+                                       fb->image, 1));
+    nvgFill(g_vg);
+}
+
+void vg_layer_scroll(int dx, int dy) {
+    assert(g_layer[0] && "no layer");
+    begin_layer_frame(g_layer[1]);
+    fill_with_layer(g_layer[0], -dx, -dy);
+    end_layer_frame();
+    std::swap(g_layer[0], g_layer[1]);
+}
+
+void vg_layer_begin(int x, int y, int w, int h) {
+    assert(g_layer[0] && "no layer");
+    begin_layer_frame(g_layer[0]);
+    vg_clip(x, y, w, h);
+}
+
+void vg_layer_end() { end_layer_frame(); }
+
+void vg_draw_layer() {
+    assert(g_layer[0] && "no layer");
+    fill_with_layer(g_layer[0], 0, 0);
+}
+
+void vg_begin_frame(int w, int h) {
+    begin_target(w, h);
+    nvgBeginFrame(g_vg, w, h, (float)w/h);
+};
+void vg_end_frame() {
+    nvgEndFrame(g_vg);
+    end_target();
+    end_clip();
+};
+
+void vg_render_stats(int &gl_calls, int &saved) {
+    nvglRenderStats(g_vg, &gl_calls, &saved);
+}
@@ -68,13 +68,57 @@ V2<T> operator/(V2<T> a, float f) {
     return a.scale(1.0 / f);
 }
 
-void vg_init(SDL_GLContext gl_context);
+// how vg draws, chosen at startup.
+enum VGFlags {
+    // opaque strokes go against a depth buffer: front to back, so that a
+    // pixel under many strokes is shaded once, then their edges in order.
+    // The window needs a depth buffer.
+    VG_DEPTH_STROKES = 1 << 0,
+};
+// with `msaa_samples` > 0, frames are drawn multisampled and resolved at
+// their end, instead of nanovg antialiasing the edges of what it draws.
+void vg_init(SDL_GLContext gl_context, int flags, int msaa_samples);
 void vg_draw_line(int x1, int y1, int x2, int y2, int radius, Color c);
-// draw at vs[i] - offset
-void vg_draw_lines(const std::vector<V2<int>> &vs,
-                   const std::vector<bool> &visible, int radius, Color c,
-                   V2<int> offset, float zoom);
+// draw the curve through vs[0..n) at vs[i] - offset, where vs[i] and
+// vs[i + 1] are joined by the cubic with handles hs[2 * i], hs[2 * i + 1].
+// nanovg flattens it in screen space, so it stays smooth at any zoom.
+void vg_draw_curves(const V2<int> *vs, const V2<int> *hs, int n, int radius,
+                    Color c, V2<int> offset, float zoom);
 void vg_draw_rect(int x1, int y1, int x2, int y2, Color c);
 void vg_draw_circle(int x, int y, int r, Color c);
+// images are w x h RGBA texels, not premultiplied.
+int vg_create_image(int w, int h, const unsigned char *rgba);
+void vg_update_image(int image, const unsigned char *rgba);
+// update the w x h texels at (x, y) of `image` from `rgba`, which is laid
+// out like the whole image.
+void vg_update_image_region(int image, int x, int y, int w, int h,
+                            const unsigned char *rgba);
+void vg_delete_image(int image);
+// draw `image` stretched over the w x h rect at (x, y).
+void vg_draw_image(int image, float x, float y, float w, float h);
+
+// The layer: an offscreen copy of the window, which keeps what was drawn
+// into it across frames.
+// (re)create it at w x h, if it is not that size already. false if there
+// are no framebuffer objects.
+bool vg_layer_resize(int w, int h);
+// move the view over the layer by (dx, dy) pixels. What moves into view is
+// left undefined, to be drawn again.
+void vg_layer_scroll(int dx, int dy);
+// drawing between these goes into the layer, clipped to the rect at (x, y)
+// of w x h. Not within a frame.
+void vg_layer_begin(int x, int y, int w, int h);
+void vg_layer_end();
+// draw the layer over the window, within a frame.
+void vg_draw_layer();
+// clip the rest of the frame to the rect at (x, y) of w x h. GL's scissor
+// test does it, so nothing outside is even filled.
+void vg_clip(int x, int y, int w, int h);
+// swaps since the back buffer was drawn, from GLX_EXT_buffer_age: it still
+// holds that frame. 0 if unknown, and then it must be drawn in full.
+int vg_back_buffer_age();
 void vg_begin_frame(int width, int height);
 void vg_end_frame();
+// GL calls made since the last call, and those merging draws and skipping
+// state that is already set saved.
+void vg_render_stats(int &gl_calls, int &saved);